@@ -17,9 +17,70 @@ csv.LoadFile("filename.csv");
 Keep current data and load a CSV file:
 csv.LoadFile("filename.csv",false);
 
+Load a CSV file through a memory mapping (much faster for large files):
+csv.LoadFileMapped("filename.csv");
+
+Load a large CSV file with several threads (0 threads: one per core):
+csv.LoadFileParallel("filename.csv", true, threads);
+
 Save to a CSV file:
 csv.SaveFile("filename.csv");
 
+Save to a CSV file through one large buffer (optionally bypassing the OS cache),
+with the same bytes as SaveFile, line ends included:
+csv.SaveFileBuffered("filename.csv");
+csv.SaveFileBuffered("filename.csv", true);
+
+Save a large table with several threads (0 threads: one per core):
+csv.SaveFileParallel("filename.csv", threads);
+
+Files ending in .gz or .zst are decompressed while loading and compressed while
+saving. Compile with CSV_ZLIB defined (and link zlib) for .gz files and with
+CSV_ZSTD defined (and link libzstd) for .zst files:
+csv.LoadFile("filename.csv.gz");
+csv.SaveFile("filename.csv.zst");
+
+Load only some columns (none listed: all) of rows [firstrow, firstrow + rows):
+csv.LoadFile("filename.csv", columns, firstrow, rows); // columns: vector< LI >
+
+Load only the rows whose cell in a column passes a test:
+csv.LoadFileWhere("filename.csv", column, value);       // equal to value
+csv.LoadFileWhere("filename.csv", column, low, high);   // a number in [low, high]
+csv.LoadFileIf("filename.csv", column, [](string_view v) { return v.length() > 3; });
+
+Load a growing file: each call parses only the bytes added since the last call
+(the last field is left for the next call unless islast is true):
+csv.LoadFileTail("filename.csv");
+csv.LoadFileTail("filename.csv", true);
+
+Load with the reads done ahead on a second thread, several at once with
+io_uring when compiled with CSV_URING on Linux (pread when it is not available):
+csv.LoadFileAsync("filename.csv");
+
+Keep cells as slices of the mapped file and decode them when they are read,
+for files of which only a few cells are used (read only, besides Clear):
+csvlazy lazy;
+lazy.LoadFile("filename.csv");
+value = lazy.GetCell(row, column);
+
+Share a table between threads: readers take a consistent view without
+waiting for writers, writers publish each update at once:
+csvshared shared;
+shared.LoadFile("filename.csv");
+csvview view = shared.View();
+value = view.GetCell(row, column);
+shared.SetCell(row, column, value);
+shared.Update([&](csvshared::draft& d) { d.SetCell(row, column, value); d.EraseCell(row, column); });
+
+Save to and load from a binary snapshot, much faster than a CSV file:
+csv.SaveSnapshot("filename.snap");
+csv.LoadSnapshot("filename.snap");
+
+Read a snapshot in place without loading it (read only):
+csvsnapshot snap;
+snap.Open("filename.snap");
+value = snap.GetCell(row, column);
+
 Assign a value to cell:
 csv.SetCell(row, column, value);
 
@@ -29,6 +90,45 @@ value = csv.GetCell(row, column);
 Get cell value as a double:
 check=GetCellDouble(row, column, &x)
 
+Use csvhash instead of csvdata for many random reads and writes. Cells are in
+a hash table and the ordered view used by SaveFile, LBElem, UBElem and the
+iteration API is sorted when it is next needed after cells were added or erased:
+csvhash csv;
+
+Turn off the cache of parsed numbers kept for each column read by GetCellDouble:
+csv.SetNumberCache(false);
+
+Count, sum, min, max and mean of the numbers in a column (0 threads: one per core):
+csvstats stats;
+check = csv.ColumnStats(column, stats, threads); // 1 if the column has no numbers
+
+Sort rows by columns[0], then columns[1] and so on, keeping the order of rows
+with equal values (isnumeric: by number, rows without a number last; rows
+before firstrow, such as a header, stay; 0 threads: one per core):
+csv.SortRows(columns, isdescending, isnumeric, firstrow, threads); // vector< LI >
+
+Join with another csvdata: each row of csv followed by columns of each row of
+other whose keys columns hold the same values as the keys columns of the row,
+rows with no cells in the keys columns match nothing (isleft: rows of csv
+without such a row too, though not row numbers without cells; 0 threads: one
+per core):
+csv.Join(other, keys, otherkeys, columns, output, isleft, threads); // vector< LI >, output is a third csvdata
+
+Group rows by the values of keys columns, with the number of rows and the
+stats of the numbers of each of columns in each group; groups are in the order
+of their first rows and rows without cells are skipped (0 threads: one per core):
+vector< csvgroup > groups;
+csv.GroupBy(keys, columns, groups, threads); // vector< LI >
+
+Add a row after the last row (empty values make no cell):
+csv.AppendRow(values); // vector< string_view >
+
+Assign a block of cells with its top left corner at row, column:
+csv.SetBlock(row, column, values); // vector< vector< string > >
+
+Replace the data with cells sorted by row and then column:
+csv.LoadSorted(cells); // vector< csvcell >, 1 if not sorted
+
 Erase a cell:
 csv.EraseCell(row, column); // same as SetCell(row, column, "");
 
@@ -45,6 +145,9 @@ check = csv.Search(value, &row, &column);
 Search for a value from position 0, 0:
 check = csv.Search(value, &row, &column, true);
 
+Keep an index of cell values to make Search fast for many lookups:
+csv.SetIndex(true);
+
 Iteration:
 check = csv.BeginIter(&it);
 check = csv.NextIter(&it);
@@ -56,6 +159,42 @@ csv.Clear();
 () Operator (read and write):
 csv(row, column)
 
+Column store:
+csvcolumns has the same interface as csvdata (except the () operator) but
+keeps each column as one character buffer and an offsets array. It uses much
+less memory for large dense tables. Changing a cell above the last row of its
+column moves the rest of that column, so it is best for load and read work.
+csvcolumns cols;
+cols.LoadFile("filename.csv");
+With isinfer, the first samplerows rows from firstrow give each column a type:
+int, double, date (YYYY-MM-DD) or bool (true/false) when all their cells are
+written the way the type writes its values, otherwise string. Typed columns keep
+values instead of text, except in rows before firstrow (such as a header), and
+a cell that does not fit turns its column back to text:
+cols.LoadFile("filename.csv", isclear, true, samplerows, firstrow);
+csvschema schema = cols.GetSchema(); // schema.types[column], schema.nulls[column]
+
+Arena store:
+csvcells also has the csvdata interface (except the () operator). Cell text
+is kept in large slabs of a csvarena instead of one std::string per cell.
+Overwritten text stays in the arena until Clear(), which frees it at once.
+Equal values of chosen (low cardinality) columns can share one copy:
+csvcells cells;
+cells.SetIntern(column);
+cells.LoadFile("filename.csv");
+
+Row by row reading:
+csvreader reads a CSV file in a fixed size buffer and gives one row at a time
+as string_views (valid until the next row), so files larger than memory can
+be filtered or aggregated. Empty fields are empty views.
+csvreader reader;
+check = reader.Open("filename.csv");
+while (reader.NextRow(row, fields)) ...
+or
+reader.ForEachRow([&](LI row, vector< string_view >& fields) { ... return true; });
+Group the remaining rows like csvdata::GroupBy:
+reader.GroupBy(keys, columns, groups);
+
 Convert a string to a safe CSV string:
 value = SafeStr(str);
 
@@ -71,9 +210,59 @@ Last modified: Aug. 2016.
 #include "stdafx.h"
 
 #include < map >
+#include < vector >
+#include < thread >
+#include < memory >
+#include < string_view >
+#include < charconv >
+#include < unordered_set >
+#include < unordered_map >
+#include < algorithm >
+#include < type_traits >
+#include < mutex >
+#include < atomic >
+#include < condition_variable >
+#include < deque >
 
 #include < fstream >
 #include < string >
+#include < cstring >
+#include < cstdint >
+#include < cmath >
+#include < limits >
+
+#if defined(__AVX2__) || defined(__PCLMUL__)
+#include < immintrin.h >
+#endif
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && (_M_IX86_FP >= 2))
+#define CSV_SSE2
+#include < emmintrin.h >
+#endif
+#if defined(_MSC_VER)
+#include < intrin.h >
+#endif
+
+#ifdef CSV_ZLIB
+#include < zlib.h >
+#endif
+#ifdef CSV_ZSTD
+#include < zstd.h >
+#endif
+
+#ifdef _WIN32
+#include < windows.h >
+#else
+#include < fcntl.h >
+#include < sys/mman.h >
+#include < sys/stat.h >
+#include < unistd.h >
+#if defined(CSV_URING) && defined(__linux__)
+#include < linux/io_uring.h >
+#include < sys/syscall.h >
+#include < sys/uio.h >
+#include < cerrno >
+#endif
+#endif
 
 // header files used by main() function
 #include < iostream >
@@ -83,12 +272,135 @@ Last modified: Aug. 2016.
 
 using LI = unsigned long int;
 using LLI = unsigned long long int;
-union _I {
-	LLI index;
-	struct {
-		LI column;
-		LI row;
-	} at;
+// The key of a cell in the stores: the row in the high 32 bits and the column
+// in the low 32, so keys sort by row and then by column, whatever the size of LI
+inline LLI csvindex(LI row, LI column)
+{
+	return ((LLI)(row & 0xFFFFFFFFUL) << 32) | (LLI)(column & 0xFFFFFFFFUL);
+}
+inline LI csvrow(LLI index)
+{
+	return (LI)(index >> 32);
+}
+inline LI csvcolumn(LLI index)
+{
+	return (LI)(index & 0xFFFFFFFFULL);
+}
+
+/****************************************************************************/
+
+// read only memory mapping of a whole file
+class csvmapfile
+{
+private:
+#ifdef _WIN32
+	HANDLE hfile;
+	HANDLE hmap;
+#else
+	int fd;
+#endif
+public:
+	const char* data;
+	size_t size;
+	csvmapfile();
+	~csvmapfile();
+	int Open(const char* filename);
+	void Close();
+};
+
+// Compression of a file, csvauto picks it from the file name: .gz is gzip
+// (needs CSV_ZLIB) and .zst is zstd (needs CSV_ZSTD).
+enum csvcompress
+{
+	csvauto,
+	csvplain,
+	csvgzip,
+	csvzstd
+};
+
+// Line end written for '\n', as a text mode ofstream writes it, so csvwriter
+// output is the same as SaveFile output
+#ifdef _WIN32
+const char csveol[] = "\r\n";
+#else
+const char csveol[] = "\n";
+#endif
+const size_t csveolsize = sizeof(csveol) - 1;
+
+// Writes a file through one large buffer with few big write calls. Cells are
+// escaped straight into the buffer. Put() and Cell() write '\n' as csveol,
+// Write() writes bytes as they are. With isdirect the OS cache is bypassed
+// (O_DIRECT or FILE_FLAG_NO_BUFFERING): whole pages are written and the file
+// is cut to its real size on Close(). OpenAt() writes into an existing file
+// from a given offset, so several writers can fill one file. A compressed
+// file is compressed one buffer at a time and never bypasses the OS cache.
+class csvwriter
+{
+private:
+#ifdef _WIN32
+	HANDLE hfile;
+#else
+	int fd;
+#endif
+	std::vector< char > mem;
+	char* buf;
+	size_t bufsize;
+	size_t used;
+	LLI offset;
+	LLI written;
+	bool isdirect;
+	bool isat;
+	bool isfail;
+	csvcompress compress;
+	std::vector< char > packed;
+#ifdef CSV_ZLIB
+	z_stream zs;
+#endif
+#ifdef CSV_ZSTD
+	ZSTD_CCtx* zc;
+#endif
+	void _alloc(size_t size);
+	void _flush(bool islast);
+	void _pack(bool islast);
+	bool _write(const char* p, size_t n);
+public:
+	csvwriter();
+	~csvwriter();
+	int Open(const char* filename, bool isdirect = false, size_t bufsize = 1 << 22, csvcompress format = csvauto);
+	int OpenAt(const char* filename, LLI offset, size_t bufsize = 1 << 22);
+	void Put(char c);
+	void Write(const char* s, size_t n);
+	void Cell(const char* s, size_t n);
+	int Close();
+};
+
+/****************************************************************************/
+
+// Aggregates of the numeric cells of a column.
+struct csvstats
+{
+	size_t count;
+	double sum;
+	double min;
+	double max;
+	double mean;
+};
+
+// Rows with the same values of the keys columns, and the stats of the
+// numeric cells of each aggregated column in them.
+struct csvgroup
+{
+	std::vector< std::string > keys;
+	size_t rows;
+	std::vector< csvstats > stats;
+};
+
+// a cell for csvdata::LoadSorted
+struct csvcell
+{
+	LI row;
+	LI column;
+	std::string value;
 };
 
 /****************************************************************************/
@@ -97,16 +409,67 @@ class csvdata
 {
 private:
 	std::map< LLI, std::string > csv_map;
+	// positions of the cells holding a value, sorted unless isunsorted
+	struct indexentry
+	{
+		std::vector< LLI > at;
+		bool isunsorted;
+	};
+	std::unordered_map< std::string, indexentry > csv_index;
+	bool isindex;
+	bool isindexvalid;
 	LLI _index(LI row, LI column);
 	LI _row(LLI index);
 	LI _column(LLI index);
+	void _indexadd(LLI index, const std::string& value);
+	void _indexerase(LLI index, const std::string& value);
+	void _indexbuild();
+	void _rowkeys(const std::vector< LI >& keys, std::vector< std::string >& rowkeys, std::vector< std::map< LLI, std::string >::iterator >& first, LI& width);
+	int _loadstream(const char* filename, bool isahead = false);
+	// where the last LoadFileTail stopped: a field start, so outside quotes
+	std::string tailname;
+	LLI tailoffset;
+	LI tailrow;
+	LI tailcolumn;
+	// parsed values of a column read by GetCellDouble, by row
+	struct numbercolumn
+	{
+		std::vector< double > values;
+		std::vector< uint64_t > isvalue;
+		bool isdense;
+	};
+	std::unordered_map< LI, numbercolumn > csv_numbers;
+	bool isnumbercache;
+	numbercolumn* _numbers(LI column);
+	void _numberset(LI row, LI column, const std::string& value);
+	struct mapinserter;
+	struct projector;
+	template < class F >
+	struct filter;
 public:
+	using iterator = std::map< LLI, std::string >::iterator;
 	csvdata();
 	~csvdata();
 	int LoadFile(const char* filename, bool isclear = true);
+	int LoadFile(const char* filename, const std::vector< LI >& columns, LI firstrow = 0, LI rows = ~(LI)0, bool isclear = true);
+	int LoadFileWhere(const char* filename, LI column, const std::string& value, bool isclear = true);
+	int LoadFileWhere(const char* filename, LI column, double low, double high, bool isclear = true);
+	template < class F >
+	int LoadFileIf(const char* filename, LI column, F f, bool isclear = true);
+	int LoadFileMapped(const char* filename, bool isclear = true);
+	int LoadFileParallel(const char* filename, bool isclear = true, unsigned threads = 0);
+	int LoadFileAsync(const char* filename, bool isclear = true);
+	int LoadFileTail(const char* filename, bool islast = false);
 	int SaveFile(const char* filename);
+	int SaveFileBuffered(const char* filename, bool isdirect = false);
+	int SaveFileParallel(const char* filename, unsigned threads = 0);
+	int SaveSnapshot(const char* filename);
+	int LoadSnapshot(const char* filename);
 	int EraseCell(LI row, LI column);
 	int SetCell(LI row, LI column, const std::string& value);
+	int AppendRow(const std::vector< std::string_view >& values);
+	int SetBlock(LI row, LI column, const std::vector< std::vector< std::string > >& values);
+	int LoadSorted(const std::vector< csvcell >& cells);
 	std::string GetCell(LI row, LI column);
 	bool GetCellDouble(LI row, LI column, double& x);
 	bool Search(const std::string& value, LI& row, LI& column, bool is_reset = false);
@@ -116,222 +479,5696 @@ public:
 	bool BeginIter(std::map< LLI, std::string >::iterator& it);
 	bool NextIter(std::map< LLI, std::string >::iterator& it);
 	void GetIter(std::map< LLI, std::string >::iterator& it, LI& row, LI& column, std::string& value);
+	int SetIndex(bool isindex = true);
+	int SetNumberCache(bool isnumbercache = true);
+	int ColumnStats(LI column, csvstats& stats, unsigned threads = 0);
+	int SortRows(const std::vector< LI >& columns, bool isdescending = false, bool isnumeric = false, LI firstrow = 0, unsigned threads = 0);
+	int Join(csvdata& other, const std::vector< LI >& keys, const std::vector< LI >& otherkeys, const std::vector< LI >& columns, csvdata& output, bool isleft = false, unsigned threads = 0);
+	int GroupBy(const std::vector< LI >& keys, const std::vector< LI >& columns, std::vector< csvgroup >& groups, unsigned threads = 0);
 	int Clear();
 	std::string& operator() (const LI row, const LI column);
 };
 
-const std::string PrimaryStr(const std::string& s);
-const std::string SafeStr(const std::string& s);
-bool StrDouble(const std::string s, double& x);
+/****************************************************************************/
 
-using namespace std;
+// Text kept in large slabs. Text is only added and Clear() frees all slabs at
+// once. Intern() returns the copy added before for an equal text.
+class csvarena
+{
+private:
+	std::vector< std::unique_ptr< char[] > > slabs;
+	size_t used;
+	size_t slabsize;
+	std::unordered_set< std::string_view > strings;
+public:
+	csvarena();
+	const char* Add(const char* s, size_t n);
+	const char* Intern(const char* s, size_t n);
+	void Clear();
+};
+
+// cell text in a csvarena
+struct csvtext
+{
+	const char* s;
+	size_t n;
+};
+
+// csvdata with cell text in a csvarena
+class csvcells
+{
+private:
+	std::map< LLI, csvtext > csv_map;
+	csvarena arena;
+	std::vector< bool > intern;
+	LLI _index(LI row, LI column);
+	LI _row(LLI index);
+	LI _column(LLI index);
+	void _set(LI row, LI column, const char* s, size_t n);
+	struct cellinserter;
+public:
+	using iterator = std::map< LLI, csvtext >::iterator;
+	csvcells();
+	~csvcells();
+	void SetIntern(LI column, bool isintern = true);
+	int LoadFile(const char* filename, bool isclear = true);
+	int SaveFile(const char* filename);
+	int EraseCell(LI row, LI column);
+	int SetCell(LI row, LI column, const std::string& value);
+	std::string GetCell(LI row, LI column);
+	bool GetCellDouble(LI row, LI column, double& x);
+	bool Search(const std::string& value, LI& row, LI& column, bool is_reset = false);
+	bool Find(LI row, LI column, std::string& value);
+	bool LBElem(LI& row, LI& column, std::string& value);
+	bool UBElem(LI& row, LI& column, std::string& value);
+	bool BeginIter(iterator& it);
+	bool NextIter(iterator& it);
+	void GetIter(iterator& it, LI& row, LI& column, std::string& value);
+	int Clear();
+};
 
 /****************************************************************************/
 
-LLI csvdata::_index(LI row, LI column)
+// csvdata with cells in an open addressing hash table
+class csvhash
 {
-	_I i;
-	i.at.row = row;
-	i.at.column = column;
-	return i.index;
-}
-LI csvdata::_row(LLI index)
+private:
+	struct slot
+	{
+		LLI index;
+		std::string value;
+		bool isused;
+	};
+	std::vector< slot > slots;
+	size_t count;
+	std::vector< LLI > order;
+	bool isordered;
+	LLI _index(LI row, LI column);
+	LI _row(LLI index);
+	LI _column(LLI index);
+	size_t _home(LLI index);
+	slot* _find(LLI index);
+	std::string& _insert(LLI index);
+	void _erase(LLI index);
+	void _grow(size_t size);
+	void _order();
+	struct hashinserter;
+public:
+	using iterator = size_t;
+	csvhash();
+	~csvhash();
+	void Reserve(size_t cells);
+	int LoadFile(const char* filename, bool isclear = true);
+	int SaveFile(const char* filename);
+	int EraseCell(LI row, LI column);
+	int SetCell(LI row, LI column, const std::string& value);
+	std::string GetCell(LI row, LI column);
+	bool GetCellDouble(LI row, LI column, double& x);
+	bool Search(const std::string& value, LI& row, LI& column, bool is_reset = false);
+	bool Find(LI row, LI column, std::string& value);
+	bool LBElem(LI& row, LI& column, std::string& value);
+	bool UBElem(LI& row, LI& column, std::string& value);
+	bool BeginIter(iterator& it);
+	bool NextIter(iterator& it);
+	void GetIter(iterator& it, LI& row, LI& column, std::string& value);
+	int Clear();
+	std::string& operator() (const LI row, const LI column);
+};
+
+/****************************************************************************/
+
+// A snapshot file is a header followed by the cells sorted by row and column:
+//   char magic[8]      "CSVSNAP"
+//   uint32_t version   1
+//   uint32_t order     0x01020304 as written, to detect another byte order
+//   uint64_t count     number of cells
+//   uint64_t heapsize  bytes of cell text
+//   uint64_t checksum  of everything after the header
+//   uint32_t rows[count], uint32_t columns[count]
+//   uint64_t offsets[count + 1]  cell i is heap[offsets[i], offsets[i + 1])
+//   char heap[heapsize]
+// csvsnapshot maps such a file and reads cells in place.
+class csvsnapshot
 {
-	_I i;
-	i.index = index;
-	return i.at.row;
-}
-LI csvdata::_column(LLI index)
+private:
+	csvmapfile file;
+	const uint32_t* rows;
+	const uint32_t* columns;
+	const uint64_t* offsets;
+	const char* heap;
+	size_t count;
+	size_t _lower(LI row, LI column);
+public:
+	using iterator = size_t;
+	csvsnapshot();
+	~csvsnapshot();
+	int Open(const char* filename, bool ischeck = true);
+	void Close();
+	size_t Size();
+	std::string GetCell(LI row, LI column);
+	bool GetCellDouble(LI row, LI column, double& x);
+	bool Search(const std::string& value, LI& row, LI& column, bool is_reset = false);
+	bool Find(LI row, LI column, std::string& value);
+	bool LBElem(LI& row, LI& column, std::string& value);
+	bool UBElem(LI& row, LI& column, std::string& value);
+	bool BeginIter(iterator& it);
+	bool NextIter(iterator& it);
+	void GetIter(iterator& it, LI& row, LI& column, std::string& value);
+	void GetIterView(iterator& it, LI& row, LI& column, std::string_view& value);
+};
+
+/****************************************************************************/
+
+// Loads a CSV file without decoding it: each cell is kept as its byte range in
+// the mapped file, with a flag if it needs unescaping, and decoded by the call
+// that reads it. Cells are sorted, lookups are binary searches. A cell can be
+// at most 4 GB long.
+class csvlazy
 {
-	_I i;
-	i.index = index;
-	return i.at.column;
-}
+private:
+	struct slice
+	{
+		LLI index;
+		uint64_t offset;
+		uint32_t n;
+		uint32_t isescaped;
+	};
+	csvmapfile file;
+	std::vector< slice > cells;
+	std::string tmp;
+	LLI _index(LI row, LI column);
+	LI _row(LLI index);
+	LI _column(LLI index);
+	size_t _lower(LLI index);
+	void _value(const slice& c, const char*& s, size_t& n);
+	struct lazyinserter;
+public:
+	using iterator = size_t;
+	csvlazy();
+	~csvlazy();
+	int LoadFile(const char* filename);
+	int SaveFile(const char* filename);
+	size_t Size();
+	std::string GetCell(LI row, LI column);
+	bool GetCellDouble(LI row, LI column, double& x);
+	bool Search(const std::string& value, LI& row, LI& column, bool is_reset = false);
+	bool Find(LI row, LI column, std::string& value);
+	bool LBElem(LI& row, LI& column, std::string& value);
+	bool UBElem(LI& row, LI& column, std::string& value);
+	bool BeginIter(iterator& it);
+	bool NextIter(iterator& it);
+	void GetIter(iterator& it, LI& row, LI& column, std::string& value);
+	int Clear();
+};
 
-csvdata::csvdata()
+/****************************************************************************/
+
+// Rows of a csvshared table in blocks of csvblockrows rows, each block a map
+// like the one of csvdata, and blocks in pages of csvpageblocks blocks. Pages
+// and blocks are shared by all tables that did not change them, so an update
+// copies the page list, one page and one block for each block it changes.
+const LI csvblockrows = 32;
+const size_t csvpageblocks = 256;
+
+struct csvblock
 {
+	std::map< LLI, std::string > cells;
+};
 
-}
+struct csvpage
+{
+	std::vector< std::shared_ptr< const csvblock > > blocks;
+};
 
-csvdata::~csvdata()
+struct csvtable
 {
-	Clear();
-}
+	std::vector< std::shared_ptr< const csvpage > > pages;
+};
 
-int csvdata::LoadFile(const char* filename, bool isclear)
+// A read only view of a csvshared table as it was when the view was taken.
+// Reading a view needs no locking.
+class csvview
 {
-	if (isclear)
-		Clear();
+public:
+	struct iterator
+	{
+		size_t block;
+		std::map< LLI, std::string >::const_iterator it;
+	};
+private:
+	std::shared_ptr< const csvtable > table;
+	LLI _index(LI row, LI column);
+	LI _row(LLI index);
+	LI _column(LLI index);
+	bool _seek(LLI index, bool isupper, iterator& it);
+	bool _next(size_t block, iterator& it);
+	friend class csvshared;
+public:
+	csvview();
+	int SaveFile(const char* filename);
+	std::string GetCell(LI row, LI column);
+	bool GetCellDouble(LI row, LI column, double& x);
+	bool Search(const std::string& value, LI& row, LI& column, bool is_reset = false);
+	bool Find(LI row, LI column, std::string& value);
+	bool LBElem(LI& row, LI& column, std::string& value);
+	bool UBElem(LI& row, LI& column, std::string& value);
+	bool BeginIter(iterator& it);
+	bool NextIter(iterator& it);
+	void GetIter(iterator& it, LI& row, LI& column, std::string& value);
+};
 
-	LI row = 0;
-	LI column = 0;
+// csvdata for many reader threads and some writer threads. Readers use a
+// csvview (GetCell takes one per call) and take no lock: a view is a copy of
+// the published table pointer, read between two updates of a reader count.
+// Writers are serialized: an update copies what it changes into a new table
+// and publishes it with one atomic exchange, so a reader sees all of an update
+// or nothing of it. A replaced pointer is deleted once no reader is copying,
+// and old tables and blocks are freed when the last view using them goes.
+// SetCell and EraseCell are one update each; many changes are cheaper in one
+// Update.
+class csvshared
+{
+public:
+	// the changes of one update, made on private copies of the blocks they touch
+	class draft
+	{
+	private:
+		csvshared& csv;
+		csvtable table;
+		// the pages and blocks copied by this draft, by index
+		std::unordered_map< size_t, std::shared_ptr< csvpage > > ownpages;
+		std::unordered_map< size_t, std::shared_ptr< csvblock > > ownblocks;
+		std::map< LLI, std::string >& _cells(LI row);
+		void _clear();
+		friend class csvshared;
+	public:
+		draft(csvshared& shared, const csvtable& from);
+		int SetCell(LI row, LI column, const std::string& value);
+		int EraseCell(LI row, LI column);
+		std::string GetCell(LI row, LI column);
+	};
+private:
+	// current is the table of the last update, for writers; published points
+	// to a copy of it for readers, retired to copies replaced while reading
+	std::shared_ptr< const csvtable > current;
+	std::atomic< std::shared_ptr< const csvtable >* > published;
+	std::atomic< size_t > reading;
+	std::vector< std::shared_ptr< const csvtable >* > retired;
+	std::mutex writing;
+	LLI _index(LI row, LI column);
+	void _publish(std::shared_ptr< const csvtable > table);
+	struct sharedinserter;
+public:
+	csvshared();
+	~csvshared();
+	csvview View();
+	int LoadFile(const char* filename);
+	int SaveFile(const char* filename);
+	std::string GetCell(LI row, LI column);
+	bool GetCellDouble(LI row, LI column, double& x);
+	int SetCell(LI row, LI column, const std::string& value);
+	int EraseCell(LI row, LI column);
+	template < class F >
+	int Update(F f);
+	int Clear();
+};
 
-	string cell = "";
+/****************************************************************************/
 
-	bool qflag = false;
+// Reads the bytes of a file, decompressing .gz and .zst files. A compressed
+// file is decoded by a second thread a few blocks ahead of Read(), so decoding
+// overlaps with the work of the caller. With isahead a plain file is read
+// ahead by a second thread the same way.
+class csvinput
+{
+private:
+	FILE* file;
+	csvcompress compress;
+	bool isthread;
+	std::thread worker;
+	std::mutex lock;
+	std::condition_variable change;
+	std::deque< std::vector< char > > full;
+	std::vector< std::vector< char > > spare;
+	std::vector< char > block;
+	size_t blockpos;
+	bool isdone;
+	bool isstop;
+	bool isfail;
+	std::vector< char > _take();
+	bool _push(std::vector< char >& b, size_t n);
+	void _decode();
+	void _readahead();
+public:
+	csvinput();
+	~csvinput();
+	int Open(const char* filename, csvcompress format = csvauto, bool isahead = false);
+	size_t Read(char* p, size_t n);
+	bool IsFail();
+	void Close();
+};
 
-	char c;
+/****************************************************************************/
 
-	ifstream is(filename);
+// Reads a CSV file row by row in a buffer that only grows for rows larger
+// than it. Uses the same scanner as LoadFileMapped.
+class csvreader
+{
+private:
+	struct field
+	{
+		size_t offset;
+		size_t n;
+		bool isscratch;
+	};
+	csvinput input;
+	std::vector< char > buf;
+	size_t pos;
+	size_t len;
+	bool iseof;
+	LI row;
+	std::vector< field > cells;
+	std::string scratch;
+	bool _fill();
+	struct rowcollector;
+public:
+	csvreader();
+	~csvreader();
+	int Open(const char* filename, size_t bufsize = 1 << 20, csvcompress format = csvauto, bool isahead = false);
+	bool NextRow(LI& row, std::vector< std::string_view >& fields);
+	template < class F >
+	int ForEachRow(F f);
+	int GroupBy(const std::vector< LI >& keys, const std::vector< LI >& columns, std::vector< csvgroup >& groups);
+	bool IsFail();
+	void Close();
+};
 
-	if (!is.good())
-		return 1;
+/****************************************************************************/
 
-	while (is.get(c))
+// Types of csvcolumns columns
+enum csvtype
+{
+	csvstring,
+	csvint,
+	csvdouble,
+	csvdate,
+	csvbool
+};
+
+// The type of each column and the share of its cells that were empty in the
+// sampled rows
+struct csvschema
+{
+	std::vector< csvtype > types;
+	std::vector< double > nulls;
+};
+
+// Column store in the style of Arrow string columns: cell (row, column) is
+// chars[offsets[row], offsets[row + 1]) of its column, an empty range is an
+// empty cell. Columns are dense, so column indices should be small.
+class csvcolumns
+{
+private:
+	struct column
 	{
-		if (qflag)
-		{
-			if (c == '"')
-			{
-				if (is.peek() == '"')
-				{
-					is.get(c);
-					cell += c;
-				}
-				else
-					qflag = false;
-			}
-			else
-				cell += c;
-		}
-		else
-		{
-			if ((c == '"') && (cell.length() == 0))
-				qflag = true;
-			else if (c == ',')
-			{
-				if (cell.length() > 0)
-				{
-					csv_map[_index(row, column)] = cell;
-					cell = "";
-				}
-				column++;
-			}
-			else if (c == '\n')
-			{
-				if (cell.length() > 0)
-				{
-					csv_map[_index(row, column)] = cell;
-					cell = "";
+		std::vector< LLI > offsets;
+		std::string chars;
+		// a typed column keeps values: integers for int, date (days from
+		// 1970-01-01) and bool, numbers for double; bit row of isvalue is set
+		// for cells with a value
+		csvtype type;
+		// double: digits after the point, -1 for the shortest form
+		int decimals;
+		bool isupper;
+		std::vector< int64_t > integers;
+		std::vector< double > numbers;
+		std::vector< uint64_t > isvalue;
+		// rows before headrows of a typed column keep text, in head
+		LI headrows;
+		std::vector< std::string > head;
+		double nulls;
+	};
+	std::vector< column > columns;
+	LI rows;
+	bool _cell(LI row, LI column, const char*& s, size_t& n, char* buf);
+	bool _has(LI row, LI column);
+	void _set(LI row, LI column, const char* s, size_t n);
+	bool _seek(LLI row, LLI column, LI& r, LI& c);
+	size_t _format(const column& c, int64_t i, double x, char* buf);
+	bool _parse(const column& c, const char* s, size_t n, int64_t& i, double& x);
+	void _totext(column& c);
+	struct columninserter;
+	struct sampler;
+public:
+	struct iterator
+	{
+		LI row;
+		LI column;
+	};
+	csvcolumns();
+	~csvcolumns();
+	int LoadFile(const char* filename, bool isclear = true, bool isinfer = false, LI samplerows = 1000, LI firstrow = 0);
+	csvschema GetSchema();
+	int SaveFile(const char* filename);
+	int EraseCell(LI row, LI column);
+	int SetCell(LI row, LI column, const std::string& value);
+	std::string GetCell(LI row, LI column);
+	bool GetCellDouble(LI row, LI column, double& x);
+	bool Search(const std::string& value, LI& row, LI& column, bool is_reset = false);
+	bool Find(LI row, LI column, std::string& value);
+	bool LBElem(LI& row, LI& column, std::string& value);
+	bool UBElem(LI& row, LI& column, std::string& value);
+	bool BeginIter(iterator& it);
+	bool NextIter(iterator& it);
+	void GetIter(iterator& it, LI& row, LI& column, std::string& value);
+	int Clear();
+};
+
+const std::string PrimaryStr(const std::string& s);
+const std::string SafeStr(const std::string& s);
+bool StrDouble(const std::string s, double& x);
+bool StrDouble(const char* s, size_t n, double& x);
+
+using namespace std;
+
+/****************************************************************************/
+
+csvmapfile::csvmapfile()
+{
+#ifdef _WIN32
+	hfile = INVALID_HANDLE_VALUE;
+	hmap = NULL;
+#else
+	fd = -1;
+#endif
+	data = nullptr;
+	size = 0;
+}
+
+csvmapfile::~csvmapfile()
+{
+	Close();
+}
+
+int csvmapfile::Open(const char* filename)
+{
+	Close();
+#ifdef _WIN32
+	hfile = CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+	if (hfile == INVALID_HANDLE_VALUE)
+		return 1;
+	LARGE_INTEGER fsize;
+	if (!GetFileSizeEx(hfile, &fsize))
+	{
+		Close();
+		return 1;
+	}
+	size = (size_t)fsize.QuadPart;
+	if (size == 0)
+		return 0;
+	hmap = CreateFileMappingA(hfile, NULL, PAGE_READONLY, 0, 0, NULL);
+	if (hmap == NULL)
+	{
+		Close();
+		return 1;
+	}
+	data = (const char*)MapViewOfFile(hmap, FILE_MAP_READ, 0, 0, 0);
+#else
+	fd = open(filename, O_RDONLY);
+	if (fd == -1)
+		return 1;
+	struct stat st;
+	if (fstat(fd, &st) != 0)
+	{
+		Close();
+		return 1;
+	}
+	size = (size_t)st.st_size;
+	if (size == 0)
+		return 0;
+	void* p = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+	if (p == MAP_FAILED)
+		p = nullptr;
+	else
+		madvise(p, size, MADV_SEQUENTIAL);
+	data = (const char*)p;
+#endif
+	if (data == nullptr)
+	{
+		Close();
+		return 1;
+	}
+	return 0;
+}
+
+void csvmapfile::Close()
+{
+#ifdef _WIN32
+	if (data != nullptr)
+		UnmapViewOfFile(data);
+	if (hmap != NULL)
+		CloseHandle(hmap);
+	if (hfile != INVALID_HANDLE_VALUE)
+		CloseHandle(hfile);
+	hfile = INVALID_HANDLE_VALUE;
+	hmap = NULL;
+#else
+	if (data != nullptr)
+		munmap((void*)data, size);
+	if (fd != -1)
+		close(fd);
+	fd = -1;
+#endif
+	data = nullptr;
+	size = 0;
+}
+
+/****************************************************************************/
+
+csvcompress csvformat(const char* filename)
+{
+	size_t n = strlen(filename);
+	if ((n > 3) && (strcmp(filename + n - 3, ".gz") == 0))
+		return csvgzip;
+	if ((n > 4) && (strcmp(filename + n - 4, ".zst") == 0))
+		return csvzstd;
+	return csvplain;
+}
+
+csvwriter::csvwriter()
+{
+#ifdef _WIN32
+	hfile = INVALID_HANDLE_VALUE;
+#else
+	fd = -1;
+#endif
+	buf = nullptr;
+	bufsize = 0;
+	used = 0;
+	offset = 0;
+	written = 0;
+	isdirect = false;
+	isat = false;
+	isfail = false;
+	compress = csvplain;
+#ifdef CSV_ZSTD
+	zc = nullptr;
+#endif
+}
+
+csvwriter::~csvwriter()
+{
+	Close();
+}
+
+int csvwriter::Open(const char* filename, bool direct, size_t size, csvcompress format)
+{
+	Close();
+	compress = (format == csvauto) ? csvformat(filename) : format;
+#ifdef CSV_ZLIB
+	if (compress == csvgzip)
+	{
+		memset(&zs, 0, sizeof(zs));
+		if (deflateInit2(&zs, Z_DEFAULT_COMPRESSION, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+			return 1;
+	}
+#else
+	if (compress == csvgzip)
+		return 1;
+#endif
+#ifdef CSV_ZSTD
+	if (compress == csvzstd)
+	{
+		zc = ZSTD_createCCtx();
+		if (zc == nullptr)
+			return 1;
+	}
+#else
+	if (compress == csvzstd)
+		return 1;
+#endif
+	isdirect = direct && (compress == csvplain);
+#ifdef _WIN32
+	DWORD flags = isdirect ? FILE_FLAG_NO_BUFFERING | FILE_FLAG_SEQUENTIAL_SCAN : FILE_FLAG_SEQUENTIAL_SCAN;
+	hfile = CreateFileA(filename, GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, flags, NULL);
+	if ((hfile == INVALID_HANDLE_VALUE) && isdirect)
+	{
+		isdirect = false;
+		hfile = CreateFileA(filename, GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+	}
+	if (hfile == INVALID_HANDLE_VALUE)
+		return 1;
+#else
+	fd = -1;
+#ifdef O_DIRECT
+	if (isdirect)
+		fd = open(filename, O_WRONLY | O_CREAT | O_TRUNC | O_DIRECT, 0644);
+#endif
+	if (fd == -1)
+	{
+		isdirect = false;
+		fd = open(filename, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	}
+	if (fd == -1)
+		return 1;
+#endif
+	isat = false;
+	offset = 0;
+	_alloc(size);
+	return 0;
+}
+
+int csvwriter::OpenAt(const char* filename, LLI at, size_t size)
+{
+	Close();
+	isdirect = false;
+	compress = csvplain;
+#ifdef _WIN32
+	hfile = CreateFileA(filename, GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_WRITE, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+	if (hfile == INVALID_HANDLE_VALUE)
+		return 1;
+#else
+	fd = open(filename, O_WRONLY);
+	if (fd == -1)
+		return 1;
+#endif
+	isat = true;
+	offset = at;
+	_alloc(size);
+	return 0;
+}
+
+// page aligned buffer, a whole number of pages
+void csvwriter::_alloc(size_t size)
+{
+	const size_t page = 4096;
+	bufsize = (size < page) ? page : size / page * page;
+	mem.resize(bufsize + page);
+	buf = mem.data() + (page - (size_t)((uintptr_t)mem.data() % page)) % page;
+	used = 0;
+	written = 0;
+	isfail = false;
+}
+
+// writes p[0, n) at offset + written, does not move written
+bool csvwriter::_write(const char* p, size_t n)
+{
+	size_t done = 0;
+	while (done < n)
+	{
+		LLI at = offset + written + done;
+#ifdef _WIN32
+		DWORD k = 0;
+		DWORD part = (n - done > (1u << 30)) ? (1u << 30) : (DWORD)(n - done);
+		OVERLAPPED ov = {};
+		ov.Offset = (DWORD)at;
+		ov.OffsetHigh = (DWORD)(at >> 32);
+		if (!WriteFile(hfile, p + done, part, &k, isat ? &ov : NULL) || (k == 0))
+#else
+		ssize_t k = isat ? pwrite(fd, p + done, n - done, (off_t)at) : write(fd, p + done, n - done);
+		if (k <= 0)
+#endif
+			return false;
+		done += k;
+	}
+	return true;
+}
+
+void csvwriter::_flush(bool islast)
+{
+	if (compress != csvplain)
+	{
+		_pack(islast);
+		return;
+	}
+	const size_t page = 4096;
+	size_t n = used;
+	if (isdirect)
+	{
+		if (islast)
+		{
+			n = (used + page - 1) / page * page;
+			memset(buf + used, 0, n - used);
+		}
+		else
+			n = used / page * page;
+	}
+	if (!_write(buf, n))
+		isfail = true;
+	size_t real = (n > used) ? used : n;
+	written += real;
+	memmove(buf, buf + real, used - real);
+	used -= real;
+}
+
+// compresses the buffer and writes the output, ends the stream on islast
+void csvwriter::_pack(bool islast)
+{
+	packed.resize(1 << 20);
+#ifdef CSV_ZLIB
+	if (compress == csvgzip)
+	{
+		zs.next_in = (Bytef*)buf;
+		zs.avail_in = (uInt)used;
+		int ret;
+		do
+		{
+			zs.next_out = (Bytef*)packed.data();
+			zs.avail_out = (uInt)packed.size();
+			ret = deflate(&zs, islast ? Z_FINISH : Z_NO_FLUSH);
+			size_t k = packed.size() - zs.avail_out;
+			if ((ret == Z_STREAM_ERROR) || !_write(packed.data(), k))
+			{
+				isfail = true;
+				break;
+			}
+			written += k;
+		} while ((zs.avail_out == 0) || (islast && (ret != Z_STREAM_END)));
+		if (islast)
+			deflateEnd(&zs);
+	}
+#endif
+#ifdef CSV_ZSTD
+	if (compress == csvzstd)
+	{
+		ZSTD_inBuffer in = { buf, used, 0 };
+		for (;;)
+		{
+			ZSTD_outBuffer out = { packed.data(), packed.size(), 0 };
+			size_t rest = ZSTD_compressStream2(zc, &out, &in, islast ? ZSTD_e_end : ZSTD_e_continue);
+			if (ZSTD_isError(rest) || !_write(packed.data(), out.pos))
+			{
+				isfail = true;
+				break;
+			}
+			written += out.pos;
+			if (islast ? (rest == 0) : (in.pos == in.size))
+				break;
+		}
+		if (islast)
+		{
+			ZSTD_freeCCtx(zc);
+			zc = nullptr;
+		}
+	}
+#endif
+	used = 0;
+	if (islast)
+		packed = vector< char >();
+}
+
+inline void csvwriter::Put(char c)
+{
+	if ((c == '\n') && (csveolsize > 1))
+		Put('\r');
+	if (used == bufsize)
+		_flush(false);
+	buf[used++] = c;
+}
+
+void csvwriter::Write(const char* s, size_t n)
+{
+	while (n > 0)
+	{
+		if (used == bufsize)
+			_flush(false);
+		size_t k = (n < bufsize - used) ? n : bufsize - used;
+		memcpy(buf + used, s, k);
+		used += k;
+		s += k;
+		n -= k;
+	}
+}
+
+// length of a cell written as SafeStr does
+size_t csvcellsize(const char* s, size_t n)
+{
+	size_t k = 0;
+	if ((n > 0) && (s[0] == '"') && (s[n - 1] == '"'))
+	{
+		k = 2;
+		for (size_t i = 1; i + 1 < n; i++)
+			if (s[i] == '"')
+			{
+				k += 2;
+				if (s[i + 1] == '"')
+					i++;
+			}
+			else
+				k++;
+	}
+	else if ((n > 0) && ((s[0] == '"') || memchr(s, ',', n) || memchr(s, '\n', n)))
+	{
+		k = n + 2;
+		for (const char* p = s; (p = (const char*)memchr(p, '"', s + n - p)) != nullptr; p++)
+			k++;
+	}
+	else
+		k = n;
+	if (csveolsize > 1)
+		for (const char* p = s; (p = (const char*)memchr(p, '\n', s + n - p)) != nullptr; p++)
+			k += csveolsize - 1;
+	return k;
+}
+
+// writes a cell as SafeStr does; a '\n' (only in quoted cells) takes at most
+// two bytes like a '"', so 2 * n + 2 bytes are enough
+void csvwriter::Cell(const char* s, size_t n)
+{
+	if (2 * n + 2 > bufsize - used)
+	{
+		_flush(false);
+		if (2 * n + 2 > bufsize - used)
+		{
+			string t = SafeStr(string(s, n));
+			if (csveolsize == 1)
+				Write(t.data(), t.length());
+			else
+				for (char c : t)
+					Put(c);
+			return;
+		}
+	}
+	char* p = buf + used;
+	if ((n > 0) && (s[0] == '"') && (s[n - 1] == '"'))
+	{
+		*p++ = '"';
+		for (size_t i = 1; i + 1 < n; i++)
+			if (s[i] == '"')
+			{
+				*p++ = '"';
+				*p++ = '"';
+				if (s[i + 1] == '"')
+					i++;
+			}
+			else
+			{
+				if ((s[i] == '\n') && (csveolsize > 1))
+					*p++ = '\r';
+				*p++ = s[i];
+			}
+		*p++ = '"';
+	}
+	else if ((n > 0) && ((s[0] == '"') || memchr(s, ',', n) || memchr(s, '\n', n)))
+	{
+		*p++ = '"';
+		for (size_t i = 0; i < n; i++)
+		{
+			if (s[i] == '"')
+				*p++ = '"';
+			else if ((s[i] == '\n') && (csveolsize > 1))
+				*p++ = '\r';
+			*p++ = s[i];
+		}
+		*p++ = '"';
+	}
+	else
+	{
+		memcpy(p, s, n);
+		p += n;
+	}
+	used = p - buf;
+}
+
+int csvwriter::Close()
+{
+	if (buf == nullptr)
+		return 0;
+	LLI size = written + used;
+	_flush(true);
+#ifdef _WIN32
+	if (isdirect)
+	{
+		LARGE_INTEGER at;
+		at.QuadPart = (LONGLONG)size;
+		if (!SetFilePointerEx(hfile, at, NULL, FILE_BEGIN) || !SetEndOfFile(hfile))
+			isfail = true;
+	}
+	CloseHandle(hfile);
+	hfile = INVALID_HANDLE_VALUE;
+#else
+	if (isdirect && (ftruncate(fd, (off_t)size) != 0))
+		isfail = true;
+	if (close(fd) != 0)
+		isfail = true;
+	fd = -1;
+#endif
+	mem.clear();
+	buf = nullptr;
+	return isfail ? 1 : 0;
+}
+
+/****************************************************************************/
+
+// true for a field that is one quoted text without quotes or '\r' inside, so
+// its text is the field without the two quotes
+inline bool csvquotedonly(const char* b, const char* e)
+{
+	return (*b == '"') && (e - b > 2) && (e[-1] == '"') && (memchr(b + 1, '"', e - b - 2) == nullptr)
+		&& (memchr(b + 1, '\r', e - b - 2) == nullptr);
+}
+
+// Decodes the raw bytes of one field (between two delimiters) with the same
+// rules as LoadFile. The result points into the field itself when it needs no
+// unescaping, otherwise into tmp. Returns false for an empty cell. "\r\n" in
+// quotes is read as "\n", as LoadFile reads it in text mode on Windows.
+bool csvfield(const char* b, const char* e, string& tmp, const char*& s, size_t& n)
+{
+	const char* p = b;
+	while ((p < e) && (*p != '"') && (*p >= 32))
+		p++;
+	if (p == e)
+	{
+		s = b;
+		n = e - b;
+		return (n > 0);
+	}
+	if (csvquotedonly(b, e))
+	{
+		s = b + 1;
+		n = e - b - 2;
+		return true;
+	}
+
+	tmp.assign(b, p - b);
+	bool qflag = false;
+	for (; p < e; p++)
+	{
+		char c = *p;
+		if (qflag)
+		{
+			if (c == '"')
+			{
+				if ((p + 1 < e) && (p[1] == '"'))
+				{
+					tmp += c;
+					p++;
 				}
-				row++;
-				column = 0;
+				else
+					qflag = false;
 			}
+			else if ((c != '\r') || (p + 1 == e) || (p[1] != '\n'))
+				tmp += c;
+		}
+		else
+		{
+			if ((c == '"') && (tmp.length() == 0))
+				qflag = true;
 			else if (c >= 32)
-				cell += c;
+				tmp += c;
 		}
 	}
-	if (cell.length() > 0)
-		csv_map[_index(row, column)] = cell;
+	s = tmp.data();
+	n = tmp.length();
+	return (n > 0);
+}
 
-	is.close();
-	return 0;
+// bit masks of one block of up to 64 bytes, bit i is byte i of the block
+struct csvmasks
+{
+	uint64_t quote;		// '"'
+	uint64_t delim;		// ',' and '\n'
+	uint64_t newline;	// '\n'
+	uint64_t control;	// bytes dropped outside quotes (c < 32)
+};
+
+inline uint64_t csvbits(const char* p, char c)
+{
+#if defined(__AVX2__)
+	__m256i v = _mm256_set1_epi8(c);
+	uint64_t lo = (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i*)p), v));
+	uint64_t hi = (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i*)(p + 32)), v));
+	return lo | (hi << 32);
+#elif defined(CSV_SSE2)
+	__m128i v = _mm_set1_epi8(c);
+	uint64_t r = 0;
+	for (int k = 0; k < 4; k++)
+		r |= (uint64_t)(uint16_t)_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)(p + 16 * k)), v)) << (16 * k);
+	return r;
+#else
+	uint64_t r = 0;
+	for (int k = 0; k < 64; k++)
+		r |= (uint64_t)(p[k] == c) << k;
+	return r;
+#endif
+}
+
+inline uint64_t csvcontrolbits(const char* p)
+{
+#if defined(__AVX2__)
+	__m256i v = _mm256_set1_epi8(32);
+	uint64_t lo = (uint32_t)_mm256_movemask_epi8(_mm256_cmpgt_epi8(v, _mm256_loadu_si256((const __m256i*)p)));
+	uint64_t hi = (uint32_t)_mm256_movemask_epi8(_mm256_cmpgt_epi8(v, _mm256_loadu_si256((const __m256i*)(p + 32))));
+	return lo | (hi << 32);
+#elif defined(CSV_SSE2)
+	__m128i v = _mm_set1_epi8(32);
+	uint64_t r = 0;
+	for (int k = 0; k < 4; k++)
+		r |= (uint64_t)(uint16_t)_mm_movemask_epi8(_mm_cmpgt_epi8(v, _mm_loadu_si128((const __m128i*)(p + 16 * k)))) << (16 * k);
+	return r;
+#else
+	uint64_t r = 0;
+	for (int k = 0; k < 64; k++)
+		r |= (uint64_t)((signed char)p[k] < 32) << k;
+	return r;
+#endif
+}
+
+// Vector compares are signed, so bytes above 127 are control bytes here.
+// This is a superset of what LoadFile drops when char is unsigned, which is
+// fine: control bytes only send a field to csvfield.
+void csvblockmasks(const char* p, size_t len, csvmasks& m)
+{
+	char pad[64];
+	if (len < 64)
+	{
+		memcpy(pad, p, len);
+		memset(pad + len, 'a', 64 - len);
+		p = pad;
+	}
+	m.quote = csvbits(p, '"');
+	m.newline = csvbits(p, '\n');
+	m.delim = csvbits(p, ',') | m.newline;
+	m.control = csvcontrolbits(p);
+}
+
+// bit i of the result is the xor of bits 0..i of x
+inline uint64_t csvprefixxor(uint64_t x)
+{
+#if defined(__PCLMUL__)
+	return (uint64_t)_mm_cvtsi128_si64(_mm_clmulepi64_si128(_mm_set_epi64x(0, (long long)x), _mm_set1_epi8(-1), 0));
+#else
+	x ^= x << 1;
+	x ^= x << 2;
+	x ^= x << 4;
+	x ^= x << 8;
+	x ^= x << 16;
+	x ^= x << 32;
+	return x;
+#endif
+}
+
+inline unsigned csvctz(uint64_t x)
+{
+#if defined(_MSC_VER)
+	unsigned long i;
+	_BitScanForward64(&i, x);
+	return (unsigned)i;
+#else
+	return (unsigned)__builtin_ctzll(x);
+#endif
+}
+
+// index of the highest set bit
+inline unsigned csvhighbit(uint64_t x)
+{
+#if defined(_MSC_VER)
+	unsigned long i;
+	_BitScanReverse64(&i, x);
+	return (unsigned)i;
+#else
+	return 63 - (unsigned)__builtin_clzll(x);
+#endif
+}
+
+inline unsigned csvpopcount(uint64_t x)
+{
+#if defined(_MSC_VER)
+	return (unsigned)__popcnt64(x);
+#else
+	return (unsigned)__builtin_popcountll(x);
+#endif
+}
+
+// true for a handler with rawcell(row, column, b, e, isplain), which gets the
+// undecoded bytes [b, e) of each non-empty field instead of cell()
+template < class H, class = void >
+struct csvisraw : false_type {};
+template < class H >
+struct csvisraw< H, void_t< decltype(&H::rawcell) > > : true_type {};
+
+// Decodes the field buf[start, end) and moves to the next cell. At the end of
+// a row, asks h.endrow(next) whether to go on, next is the start of the next row.
+template < class H >
+inline bool csvemit(const char* buf, size_t start, size_t end, bool isplain, char delim, LI& row, LI& column, string& tmp, H& h)
+{
+	const char* s;
+	size_t n;
+	if constexpr (csvisraw< H >::value)
+	{
+		if (end > start)
+			h.rawcell(row, column, buf + start, buf + end, isplain);
+	}
+	else if (isplain)
+	{
+		if (end > start)
+			h.cell(row, column, buf + start, end - start);
+	}
+	else if (csvfield(buf + start, buf + end, tmp, s, n))
+		h.cell(row, column, s, n);
+	if (delim == ',')
+		column++;
+	else if (delim == '\n')
+	{
+		row++;
+		column = 0;
+		return h.endrow(end + 1);
+	}
+	return true;
+}
+
+// Byte by byte scan of LoadFile from i (a field start, outside quotes) until
+// at least target. Returns the position reached and sets qflag to the quote
+// state there, or sets isstop if the handler stopped at the end of a row.
+template < class H >
+size_t csvscanbytes(const char* buf, size_t len, size_t i, size_t target, size_t& start, bool& qflag, bool& isstop, LI& row, LI& column, string& tmp, H& h)
+{
+	bool isempty = true;
+	qflag = false;
+	while ((i < len) && ((i < target) || qflag))
+	{
+		if (qflag)
+		{
+			const char* q = (const char*)memchr(buf + i, '"', len - i);
+			if (q == nullptr)
+				return len;
+			size_t j = q - buf;
+			if (j > i)
+				isempty = false;
+			if ((j + 1 < len) && (buf[j + 1] == '"'))
+			{
+				isempty = false;
+				i = j + 2;
+			}
+			else
+			{
+				qflag = false;
+				i = j + 1;
+			}
+			continue;
+		}
+		char c = buf[i];
+		if ((c == '"') && isempty)
+			qflag = true;
+		else if ((c == ',') || (c == '\n'))
+		{
+			isstop = !csvemit(buf, start, i, false, c, row, column, tmp, h);
+			start = i + 1;
+			if (isstop)
+				return start;
+			isempty = true;
+		}
+		else if (c >= 32)
+			isempty = false;
+		i++;
+	}
+	return i;
+}
+
+// Scans a buffer of CSV text and passes every non-empty cell to
+// h.cell(row, column, s, n). If islast is false, the last (maybe incomplete)
+// field is left unscanned; the return value is the number of bytes consumed
+// and row, column are where the next call continues. The scan also stops
+// after a row for which h.endrow() returns false.
+//
+// The buffer is scanned in blocks of 64 bytes. Quote, delimiter and control
+// masks are built with SSE2/AVX2 compares, and a prefix xor of the quote mask
+// gives the bytes inside quotes, so field boundaries are the delimiters
+// outside them. Only boundaries are visited; fields without quotes or control
+// bytes are passed on as they are, others go through csvfield.
+// The prefix xor assumes every quote toggles the state. A quote that opens
+// after some text of its cell is kept as text by LoadFile, so it is removed
+// from the quote mask and the block is masked again. Only a quote preceded by
+// nothing but control bytes in its cell is left to a byte by byte scan.
+template < class H >
+size_t csvscan(const char* buf, size_t len, LI& row, LI& column, bool islast, H& h)
+{
+	string tmp;
+	csvmasks m;
+	size_t start = 0;			// start of the current field
+	size_t pos = 0;				// start of the current block
+	bool inquote = false;		// quote state at pos
+	bool prevclose = false;		// the byte before pos closed a quote
+	bool isplain = true;		// no quote or control byte from start to pos
+	bool hastext = false;		// a text byte from start to pos
+	bool isstop = false;
+
+	while (pos < len)
+	{
+		size_t blen = (len - pos < 64) ? len - pos : 64;
+		csvblockmasks(buf + pos, blen, m);
+
+		uint64_t text = ~(m.quote | m.control | m.delim);
+		uint64_t inside, bounds, closing, opening;
+		bool isbyte = false;
+		for (;;)
+		{
+			inside = csvprefixxor(m.quote) ^ (inquote ? ~0ULL : 0);
+			bounds = m.delim & ~inside;
+			opening = m.quote & inside;
+			closing = m.quote & ~inside;
+			uint64_t atstart = (bounds << 1) | ((start == pos) ? 1 : 0);
+			uint64_t escaped = (closing << 1) | (prevclose ? 1 : 0);
+			uint64_t bad = opening & ~atstart & ~escaped;
+			if (bad == 0)
+				break;
+			unsigned k = csvctz(bad);
+			uint64_t below = (1ULL << k) - 1;
+			uint64_t cell = below;
+			if (bounds & below)
+				cell &= ~((2ULL << csvhighbit(bounds & below)) - 1);
+			if ((text & cell) || (((bounds & below) == 0) && hastext))
+				m.quote &= ~(1ULL << k);
+			else
+			{
+				isbyte = true;
+				break;
+			}
+		}
+		if (isbyte)
+		{
+			pos = csvscanbytes(buf, len, start, pos + blen, start, inquote, isstop, row, column, tmp, h);
+			if (isstop)
+				return start;
+			prevclose = false;
+			isplain = false;
+			hastext = false;
+			continue;
+		}
+
+		uint64_t special = m.quote | m.control;
+		while (bounds)
+		{
+			unsigned k = csvctz(bounds);
+			uint64_t below = (1ULL << k) - 1;
+			size_t i = pos + k;
+			isstop = !csvemit(buf, start, i, isplain && !(special & below), buf[i], row, column, tmp, h);
+			start = i + 1;
+			if (isstop)
+				return start;
+			special &= ~((2ULL << k) - 1);
+			isplain = true;
+			hastext = false;
+			bounds &= bounds - 1;
+		}
+		if (special)
+			isplain = false;
+		if (blen < 64)
+			text &= (1ULL << blen) - 1;
+		if (start > pos)
+			text &= ~((2ULL << (start - pos - 1)) - 1);
+		if (text)
+			hastext = true;
+		inquote = (inside >> 63) != 0;
+		prevclose = (closing >> 63) != 0;
+		pos += blen;
+	}
+	if (!islast)
+		return start;
+	csvemit(buf, start, len, false, 0, row, column, tmp, h);
+	return len;
+}
+
+// moves the writer from (row, column) to cell (r, c)
+inline void csvmoveto(csvwriter& w, LI& row, LI& column, LI r, LI c)
+{
+	if (row < r)
+	{
+		while (row < r)
+		{
+			w.Put('\n');
+			row++;
+		}
+		column = 0;
+	}
+	while (column < c)
+	{
+		w.Put(',');
+		column++;
+	}
+}
+
+// SaveFile through the iteration API of a table
+template < class T >
+int csvsave(T& csv, const char* filename, bool isdirect = false)
+{
+	LI row = 0;
+	LI column = 0;
+
+	csvwriter w;
+	if (w.Open(filename, isdirect) != 0)
+		return 1;
+
+	typename T::iterator it;
+	LI r, c;
+	string value;
+	for (bool chk = csv.BeginIter(it); chk; chk = csv.NextIter(it))
+	{
+		csv.GetIter(it, r, c, value);
+		csvmoveto(w, row, column, r, c);
+		w.Cell(value.data(), value.length());
+	}
+
+	w.Put('\n');
+	return w.Close();
+}
+
+/****************************************************************************/
+
+LLI csvdata::_index(LI row, LI column)
+{
+	return csvindex(row, column);
+}
+LI csvdata::_row(LLI index)
+{
+	return csvrow(index);
+}
+LI csvdata::_column(LLI index)
+{
+	return csvcolumn(index);
+}
+
+csvdata::csvdata()
+{
+	isindex = false;
+	isindexvalid = true;
+	isnumbercache = true;
+	tailoffset = 0;
+	tailrow = 0;
+	tailcolumn = 0;
+}
+
+csvdata::~csvdata()
+{
+	Clear();
+}
+
+// stores the scanned cells in a map, stops at the first row ending at or after limit
+struct csvdata::mapinserter
+{
+	csvdata& csv;
+	map< LLI, string >& cells;
+	size_t limit;
+	void cell(LI row, LI column, const char* s, size_t n)
+	{
+		cells.insert_or_assign(cells.end(), csv._index(row, column), string(s, n));
+	}
+	bool endrow(size_t next)
+	{
+		return (next < limit);
+	}
+};
+
+int csvdata::LoadFile(const char* filename, bool isclear)
+{
+	if (isclear)
+		Clear();
+	isindexvalid = false;
+	csv_numbers.clear();
+	if (csvformat(filename) != csvplain)
+		return _loadstream(filename);
+
+	LI row = 0;
+	LI column = 0;
+
+	string cell = "";
+
+	bool qflag = false;
+
+	char c;
+
+	ifstream is(filename);
+
+	if (!is.good())
+		return 1;
+
+	while (is.get(c))
+	{
+		if (qflag)
+		{
+			if (c == '"')
+			{
+				if (is.peek() == '"')
+				{
+					is.get(c);
+					cell += c;
+				}
+				else
+					qflag = false;
+			}
+			else if ((c != '\r') || (is.peek() != '\n'))
+				cell += c;
+		}
+		else
+		{
+			if ((c == '"') && (cell.length() == 0))
+				qflag = true;
+			else if (c == ',')
+			{
+				if (cell.length() > 0)
+				{
+					csv_map[_index(row, column)] = cell;
+					cell = "";
+				}
+				column++;
+			}
+			else if (c == '\n')
+			{
+				if (cell.length() > 0)
+				{
+					csv_map[_index(row, column)] = cell;
+					cell = "";
+				}
+				row++;
+				column = 0;
+			}
+			else if (c >= 32)
+				cell += c;
+		}
+	}
+	if (cell.length() > 0)
+		csv_map[_index(row, column)] = cell;
+
+	is.close();
+	return 0;
+}
+
+// a compressed file, decoded on a second thread while it is parsed
+int csvdata::_loadstream(const char* filename, bool isahead)
+{
+	csvreader reader;
+	if (reader.Open(filename, 1 << 20, csvauto, isahead) != 0)
+		return 1;
+	reader.ForEachRow([&](LI row, vector< string_view >& fields)
+	{
+		for (size_t k = 0; k < fields.size(); k++)
+			if (fields[k].length() > 0)
+				csv_map.insert_or_assign(csv_map.end(), _index(row, (LI)k), string(fields[k]));
+		return true;
+	});
+	return reader.IsFail() ? 1 : 0;
+}
+
+// Keeps the cells of the listed columns in rows [first, end). Other fields are
+// passed over undecoded and the scan ends with row end - 1.
+struct csvdata::projector
+{
+	csvdata& csv;
+	const vector< bool >& keep;
+	LI first;
+	LI end;
+	LI rows;
+	string tmp;
+	void rawcell(LI row, LI column, const char* b, const char* e, bool isplain)
+	{
+		if ((row < first) || (row >= end) || (!keep.empty() && ((column >= keep.size()) || !keep[column])))
+			return;
+		const char* s;
+		size_t n;
+		if (isplain)
+			csv.csv_map.insert_or_assign(csv.csv_map.end(), csv._index(row, column), string(b, e - b));
+		else if (csvfield(b, e, tmp, s, n))
+			csv.csv_map.insert_or_assign(csv.csv_map.end(), csv._index(row, column), string(s, n));
+	}
+	bool endrow(size_t)
+	{
+		return ++rows < end;
+	}
+};
+
+int csvdata::LoadFile(const char* filename, const vector< LI >& columns, LI firstrow, LI rows, bool isclear)
+{
+	if (isclear)
+		Clear();
+	isindexvalid = false;
+	csv_numbers.clear();
+
+	vector< bool > keep;
+	for (LI c : columns)
+	{
+		if (c >= keep.size())
+			keep.resize((size_t)c + 1);
+		keep[c] = true;
+	}
+	LI endrow = (rows > ~(LI)0 - firstrow) ? ~(LI)0 : firstrow + rows;
+
+	if (csvformat(filename) != csvplain)
+	{
+		csvreader reader;
+		if (reader.Open(filename) != 0)
+			return 1;
+		reader.ForEachRow([&](LI row, vector< string_view >& fields)
+		{
+			if (row >= endrow)
+				return false;
+			if (row >= firstrow)
+				for (size_t k = 0; k < fields.size(); k++)
+					if ((fields[k].length() > 0) && (keep.empty() || ((k < keep.size()) && keep[k])))
+						csv_map.insert_or_assign(csv_map.end(), _index(row, (LI)k), string(fields[k]));
+			return (row + 1 < endrow);
+		});
+		return reader.IsFail() ? 1 : 0;
+	}
+
+	csvmapfile file;
+	if (file.Open(filename) != 0)
+		return 1;
+
+	LI row = 0;
+	LI column = 0;
+	projector h = { *this, keep, firstrow, endrow, 0, "" };
+	csvscan(file.data, file.size, row, column, true, h);
+	return 0;
+}
+
+// Keeps the rows for which f(cell of column key) is true. The fields before the
+// key are held undecoded until the key is tested, the row is dropped when the
+// test fails; the fields after it are then passed over.
+template < class F >
+struct csvdata::filter
+{
+	struct field
+	{
+		LI column;
+		const char* b;
+		const char* e;
+		bool isplain;
+	};
+	csvdata& csv;
+	LI key;
+	F& f;
+	string tmp;
+	vector< field > held;
+	LI row;
+	bool ischecked;
+	bool iskeep;
+	void _insert(const field& c)
+	{
+		const char* s;
+		size_t n;
+		if (c.isplain)
+			csv.csv_map.insert_or_assign(csv.csv_map.end(), csv._index(row, c.column), string(c.b, c.e - c.b));
+		else if (csvfield(c.b, c.e, tmp, s, n))
+			csv.csv_map.insert_or_assign(csv.csv_map.end(), csv._index(row, c.column), string(s, n));
+	}
+	void _check(string_view value)
+	{
+		ischecked = true;
+		iskeep = f(value);
+		if (iskeep)
+			for (auto& c : held)
+				_insert(c);
+		held.clear();
+	}
+	void rawcell(LI r, LI column, const char* b, const char* e, bool isplain)
+	{
+		row = r;
+		if (ischecked && !iskeep)
+			return;
+		field c = { column, b, e, isplain };
+		if (column == key)
+		{
+			const char* s = b;
+			size_t n = e - b;
+			if (!isplain && !csvfield(b, e, tmp, s, n))
+				n = 0;
+			_check(string_view(s, n));
+			if (iskeep)
+				_insert(c);
+		}
+		else if (ischecked)
+			_insert(c);
+		else
+			held.push_back(c);
+	}
+	// a row without its key cell is tested with an empty value
+	void finish()
+	{
+		if (!ischecked && !held.empty())
+			_check(string_view());
+		held.clear();
+		ischecked = false;
+		iskeep = false;
+	}
+	bool endrow(size_t)
+	{
+		finish();
+		return true;
+	}
+};
+
+template < class F >
+int csvdata::LoadFileIf(const char* filename, LI column, F f, bool isclear)
+{
+	if (isclear)
+		Clear();
+	isindexvalid = false;
+	csv_numbers.clear();
+
+	if (csvformat(filename) != csvplain)
+	{
+		csvreader reader;
+		if (reader.Open(filename) != 0)
+			return 1;
+		reader.ForEachRow([&](LI row, vector< string_view >& fields)
+		{
+			if (f((column < fields.size()) ? fields[column] : string_view()))
+				for (size_t k = 0; k < fields.size(); k++)
+					if (fields[k].length() > 0)
+						csv_map.insert_or_assign(csv_map.end(), _index(row, (LI)k), string(fields[k]));
+			return true;
+		});
+		return reader.IsFail() ? 1 : 0;
+	}
+
+	csvmapfile file;
+	if (file.Open(filename) != 0)
+		return 1;
+
+	LI row = 0;
+	LI c = 0;
+	filter< F > h = { *this, column, f, "", {}, 0, false, false };
+	csvscan(file.data, file.size, row, c, true, h);
+	h.finish();
+	return 0;
+}
+
+int csvdata::LoadFileWhere(const char* filename, LI column, const string& value, bool isclear)
+{
+	return LoadFileIf(filename, column, [&](string_view v) { return v == value; }, isclear);
+}
+
+int csvdata::LoadFileWhere(const char* filename, LI column, double low, double high, bool isclear)
+{
+	return LoadFileIf(filename, column, [&](string_view v)
+	{
+		double x;
+		return StrDouble(v.data(), v.length(), x) && (x >= low) && (x <= high);
+	}, isclear);
+}
+
+// The first call for a file (or after Clear) loads it from the start, later
+// calls scan from the saved field start. Stopping at a field start means the
+// quote state to keep is always "outside quotes". Only the pages of the new
+// bytes are read from the mapped file. A file shorter than the saved offset
+// was replaced and is loaded again from the start.
+int csvdata::LoadFileTail(const char* filename, bool islast)
+{
+	csvmapfile file;
+	if (file.Open(filename) != 0)
+		return 1;
+	if ((tailname != filename) || (file.size < tailoffset))
+	{
+		Clear();
+		tailname = filename;
+	}
+	isindexvalid = false;
+	csv_numbers.clear();
+
+	mapinserter h = { *this, csv_map, SIZE_MAX };
+	tailoffset += csvscan(file.data + tailoffset, (size_t)(file.size - tailoffset), tailrow, tailcolumn, islast, h);
+	return 0;
+}
+
+// The file is read ahead on a second thread while it is parsed.
+int csvdata::LoadFileAsync(const char* filename, bool isclear)
+{
+	if (isclear)
+		Clear();
+	isindexvalid = false;
+	csv_numbers.clear();
+	return _loadstream(filename, true);
+}
+
+int csvdata::LoadFileMapped(const char* filename, bool isclear)
+{
+	if (isclear)
+		Clear();
+	isindexvalid = false;
+	csv_numbers.clear();
+	if (csvformat(filename) != csvplain)
+		return _loadstream(filename);
+
+	csvmapfile file;
+	if (file.Open(filename) != 0)
+		return 1;
+
+	LI row = 0;
+	LI column = 0;
+	mapinserter h = { *this, csv_map, SIZE_MAX };
+	csvscan(file.data, file.size, row, column, true, h);
+	return 0;
+}
+
+// The file is split into chunks that start after the first line break at or
+// after an even split. Each chunk is scanned by its own thread, speculating
+// that this line break is outside quotes, until the first row ending at or
+// after the next split. Then, in order, a chunk that does not start where the
+// previous one really ended is scanned again from there. Cells are kept in
+// per chunk maps with chunk row numbers and moved into csv_map at the end.
+int csvdata::LoadFileParallel(const char* filename, bool isclear, unsigned threads)
+{
+	if (isclear)
+		Clear();
+	isindexvalid = false;
+	csv_numbers.clear();
+	if (csvformat(filename) != csvplain)
+		return _loadstream(filename);
+
+	csvmapfile file;
+	if (file.Open(filename) != 0)
+		return 1;
+
+	const size_t minchunk = 1 << 20;
+	if (threads == 0)
+		threads = thread::hardware_concurrency();
+	if (threads > file.size / minchunk)
+		threads = (unsigned)(file.size / minchunk);
+	if (threads == 0)
+		threads = 1;
+
+	vector< size_t > begin(1, 0);
+	for (unsigned k = 1; k < threads; k++)
+	{
+		size_t split = file.size / threads * k;
+		const char* p = (const char*)memchr(file.data + split - 1, '\n', file.size - split + 1);
+		if (p == nullptr)
+			break;
+		size_t next = p - file.data + 1;
+		if ((next > begin.back()) && (next < file.size))
+			begin.push_back(next);
+	}
+	size_t chunks = begin.size();
+	begin.push_back(file.size);
+
+	vector< map< LLI, string > > cells(chunks);
+	vector< size_t > end(chunks);
+	vector< LI > rows(chunks);
+	auto scan = [&](size_t k)
+	{
+		LI row = 0;
+		LI column = 0;
+		size_t limit = (begin[k + 1] > begin[k]) ? begin[k + 1] - begin[k] : 0;
+		mapinserter h = { *this, cells[k], limit };
+		cells[k].clear();
+		end[k] = begin[k] + csvscan(file.data + begin[k], file.size - begin[k], row, column, true, h);
+		rows[k] = row;
+	};
+
+	vector< thread > workers;
+	for (size_t k = 1; k < chunks; k++)
+		workers.emplace_back(scan, k);
+	scan(0);
+	for (auto& w : workers)
+		w.join();
+
+	for (size_t k = 1; k < chunks; k++)
+		if (begin[k] != end[k - 1])
+		{
+			begin[k] = end[k - 1];
+			scan(k);
+		}
+
+	LI rowoffset = 0;
+	for (size_t k = 0; k < chunks; k++)
+	{
+		while (!cells[k].empty())
+		{
+			auto node = cells[k].extract(cells[k].begin());
+			node.key() = _index(_row(node.key()) + rowoffset, _column(node.key()));
+			auto it = csv_map.insert(csv_map.end(), move(node));
+			if (node)
+				it->second = move(node.mapped());
+		}
+		rowoffset += rows[k];
+	}
+	return 0;
+}
+
+int csvdata::SaveFile(const char* filename)
+{
+	if (csvformat(filename) != csvplain)
+		return SaveFileBuffered(filename);
+
+	LI row = 0;
+	LI column = 0;
+
+	ofstream os(filename);
+
+	if (!os.good())
+	{
+		return 1;
+	}
+
+	for (auto it : csv_map)
+	{
+		LLI ind = it.first;
+		if (row < _row(ind))
+		{
+			while (row<_row(ind))
+			{
+				os << "\n";
+				row++;
+			}
+			column = 0;
+		}
+		while (column < _column(ind))
+		{
+			os << ",";
+			column++;
+		}
+		os << SafeStr(it.second).c_str();
+	}
+
+	os << "\n";
+	os.close();
+	return 0;
+}
+
+int csvdata::SaveFileBuffered(const char* filename, bool isdirect)
+{
+	LI row = 0;
+	LI column = 0;
+
+	csvwriter w;
+	if (w.Open(filename, isdirect) != 0)
+		return 1;
+
+	for (auto& it : csv_map)
+	{
+		csvmoveto(w, row, column, _row(it.first), _column(it.first));
+		w.Cell(it.second.data(), it.second.length());
+	}
+
+	w.Put('\n');
+	return w.Close();
+}
+
+// 64 bit checksum of a byte stream, the same however the stream is split
+struct csvchecksum
+{
+	uint64_t h = 0;
+	uint64_t word = 0;
+	uint64_t total = 0;
+	void _mix(uint64_t w)
+	{
+		h = (h ^ w) * 0x9E3779B97F4A7C15ULL;
+		h ^= h >> 29;
+	}
+	void Add(const void* data, size_t n)
+	{
+		const char* p = (const char*)data;
+		const char* end = p + n;
+		while ((p < end) && (total & 7))
+		{
+			word |= (uint64_t)(unsigned char)*p++ << (8 * (total++ & 7));
+			if ((total & 7) == 0)
+			{
+				_mix(word);
+				word = 0;
+			}
+		}
+		for (; end - p >= 8; p += 8, total += 8)
+		{
+			uint64_t w;
+			memcpy(&w, p, 8);
+			_mix(w);
+		}
+		while (p < end)
+			word |= (uint64_t)(unsigned char)*p++ << (8 * (total++ & 7));
+	}
+	uint64_t Value()
+	{
+		csvchecksum c = *this;
+		if (c.total & 7)
+			c._mix(c.word);
+		c._mix(c.total);
+		return c.h;
+	}
+};
+
+struct csvsnapheader
+{
+	char magic[8];
+	uint32_t version;
+	uint32_t order;
+	uint64_t count;
+	uint64_t heapsize;
+	uint64_t checksum;
+};
+
+// The body is written after a blank header, which is filled in at the end.
+int csvdata::SaveSnapshot(const char* filename)
+{
+	csvsnapheader head;
+	memset(&head, 0, sizeof(head));
+	memcpy(head.magic, "CSVSNAP", 8);
+	head.version = 1;
+	head.order = 0x01020304;
+	head.count = csv_map.size();
+	head.heapsize = 0;
+
+	csvwriter w;
+	if (w.Open(filename, false, 1 << 22, csvplain) != 0)
+		return 1;
+	csvchecksum sum;
+	auto put = [&](const void* p, size_t n)
+	{
+		sum.Add(p, n);
+		w.Write((const char*)p, n);
+	};
+	w.Write((const char*)&head, sizeof(head));
+	uint32_t v;
+	for (auto& it : csv_map)
+	{
+		v = (uint32_t)_row(it.first);
+		put(&v, 4);
+	}
+	for (auto& it : csv_map)
+	{
+		v = (uint32_t)_column(it.first);
+		put(&v, 4);
+	}
+	uint64_t offset = 0;
+	put(&offset, 8);
+	for (auto& it : csv_map)
+	{
+		offset += it.second.length();
+		put(&offset, 8);
+	}
+	for (auto& it : csv_map)
+		put(it.second.data(), it.second.length());
+	if (w.Close() != 0)
+		return 1;
+
+	head.heapsize = offset;
+	head.checksum = sum.Value();
+	if (w.OpenAt(filename, 0, sizeof(head)) != 0)
+		return 1;
+	w.Write((const char*)&head, sizeof(head));
+	return w.Close();
+}
+
+int csvdata::LoadSnapshot(const char* filename)
+{
+	csvsnapshot snap;
+	if (snap.Open(filename) != 0)
+		return 1;
+	Clear();
+	csvsnapshot::iterator it;
+	for (bool chk = snap.BeginIter(it); chk; chk = snap.NextIter(it))
+	{
+		LI row, column;
+		string_view text;
+		snap.GetIterView(it, row, column, text);
+		csv_map.emplace_hint(csv_map.end(), _index(row, column), text);
+	}
+	isindexvalid = false;
+	return 0;
+}
+
+// The cells are split into one range per thread. The output of a range only
+// depends on the position of the cell before it, so each thread first counts
+// the bytes of its range, and then writes it at the sum of the counts of the
+// ranges before it with positional writes.
+int csvdata::SaveFileParallel(const char* filename, unsigned threads)
+{
+	if (csvformat(filename) != csvplain)
+		return SaveFileBuffered(filename);
+
+	const size_t mincells = 1 << 16;
+	size_t count = csv_map.size();
+	if (threads == 0)
+		threads = thread::hardware_concurrency();
+	if (threads > count / mincells)
+		threads = (unsigned)(count / mincells);
+	if (threads <= 1)
+		return SaveFileBuffered(filename);
+
+	// range k is [first[k], first[k + 1])
+	vector< iterator > first;
+	size_t i = 0;
+	for (auto it = csv_map.begin(); it != csv_map.end(); ++it, i++)
+		if (i == count / threads * first.size())
+			first.push_back(it);
+	first.push_back(csv_map.end());
+	size_t ranges = first.size() - 1;
+
+	// writer position before each range
+	vector< LI > rows(ranges, 0);
+	vector< LI > columns(ranges, 0);
+	for (size_t k = 1; k < ranges; k++)
+	{
+		auto it = prev(first[k]);
+		rows[k] = _row(it->first);
+		columns[k] = _column(it->first);
+	}
+
+	vector< LLI > sizes(ranges + 1, 0);
+	auto measure = [&](size_t k)
+	{
+		LI row = rows[k];
+		LI column = columns[k];
+		LLI n = 0;
+		for (auto it = first[k]; it != first[k + 1]; ++it)
+		{
+			LI r = _row(it->first);
+			LI c = _column(it->first);
+			if (row < r)
+			{
+				n += (LLI)(r - row) * csveolsize;
+				row = r;
+				column = 0;
+			}
+			n += c - column;
+			column = c;
+			n += csvcellsize(it->second.data(), it->second.length());
+		}
+		sizes[k + 1] = n;
+	};
+
+	csvwriter w;
+	if (w.Open(filename) != 0)
+		return 1;
+	w.Close();
+
+	vector< int > results(ranges, 0);
+	auto write = [&](size_t k)
+	{
+		LI row = rows[k];
+		LI column = columns[k];
+		csvwriter w;
+		if (w.OpenAt(filename, sizes[k]) != 0)
+		{
+			results[k] = 1;
+			return;
+		}
+		for (auto it = first[k]; it != first[k + 1]; ++it)
+		{
+			csvmoveto(w, row, column, _row(it->first), _column(it->first));
+			w.Cell(it->second.data(), it->second.length());
+		}
+		if (k == ranges - 1)
+			w.Put('\n');
+		results[k] = w.Close();
+	};
+
+	vector< thread > workers;
+	for (size_t k = 0; k < ranges; k++)
+		workers.emplace_back(measure, k);
+	for (auto& t : workers)
+		t.join();
+	for (size_t k = 1; k <= ranges; k++)
+		sizes[k] += sizes[k - 1];
+
+	workers.clear();
+	for (size_t k = 0; k < ranges; k++)
+		workers.emplace_back(write, k);
+	for (auto& t : workers)
+		t.join();
+
+	for (int r : results)
+		if (r != 0)
+			return 1;
+	return 0;
+}
+
+int csvdata::EraseCell(LI row, LI column)
+{
+	if (isindex && isindexvalid)
+	{
+		auto it = csv_map.find(_index(row, column));
+		if (it != csv_map.end())
+			_indexerase(it->first, it->second);
+	}
+	_numberset(row, column, "");
+	csv_map.erase(_index(row, column));
+	return 0;
+}
+
+int csvdata::SetCell(LI row, LI column, const string& value)
+{
+	if (isindex && isindexvalid)
+	{
+		auto it = csv_map.find(_index(row, column));
+		if (it != csv_map.end())
+			_indexerase(it->first, it->second);
+		if (value.length() > 0)
+			_indexadd(_index(row, column), value);
+	}
+	_numberset(row, column, value);
+	unsigned int len = (unsigned)value.length();
+	if (len == 0)
+	{
+		csv_map.erase(_index(row, column));
+		return 1;
+	}
+	else
+	{
+		csv_map[_index(row, column)] = value;
+		return 0;
+	}
+}
+
+// The bulk calls below insert with the position of the previous cell as a
+// hint, which costs O(1) instead of a search from the root for each cell.
+int csvdata::AppendRow(const vector< string_view >& values)
+{
+	LI row = csv_map.empty() ? 0 : _row(csv_map.rbegin()->first) + 1;
+	for (size_t i = 0; i < values.size(); i++)
+		if (values[i].length() > 0)
+			csv_map.emplace_hint(csv_map.end(), _index(row, (LI)i), values[i]);
+	isindexvalid = false;
+	csv_numbers.clear();
+	return 0;
+}
+
+int csvdata::SetBlock(LI row, LI column, const vector< vector< string > >& values)
+{
+	for (size_t i = 0; i < values.size(); i++)
+	{
+		auto it = csv_map.lower_bound(_index(row + (LI)i, column));
+		for (size_t j = 0; j < values[i].size(); j++)
+		{
+			LLI ind = _index(row + (LI)i, column + (LI)j);
+			const string& value = values[i][j];
+			if ((it != csv_map.end()) && (it->first == ind))
+			{
+				if (value.length() > 0)
+					(it++)->second = value;
+				else
+					it = csv_map.erase(it);
+			}
+			else if (value.length() > 0)
+				csv_map.emplace_hint(it, ind, value);
+		}
+	}
+	isindexvalid = false;
+	csv_numbers.clear();
+	return 0;
+}
+
+int csvdata::LoadSorted(const vector< csvcell >& cells)
+{
+	Clear();
+	for (auto& it : cells)
+	{
+		if (it.value.length() == 0)
+			continue;
+		LLI ind = _index(it.row, it.column);
+		if (!csv_map.empty() && (csv_map.rbegin()->first >= ind))
+		{
+			Clear();
+			return 1;
+		}
+		csv_map.emplace_hint(csv_map.end(), ind, it.value);
+	}
+	isindexvalid = false;
+	return 0;
+}
+
+string csvdata::GetCell(LI row, LI column)
+{
+	auto it = csv_map.find(_index(row, column));
+	if (it != csv_map.end())
+		return it->second;
+	else
+		return "";
+}
+
+bool csvdata::GetCellDouble(LI row, LI column, double& x)
+{
+	numbercolumn* nc = _numbers(column);
+	if (nc)
+	{
+		if ((row < nc->values.size()) && ((nc->isvalue[row >> 6] >> (row & 63)) & 1))
+		{
+			x = nc->values[row];
+			return true;
+		}
+		return false;
+	}
+	auto it = csv_map.find(_index(row, column));
+	if (it != csv_map.end())
+	{
+		return StrDouble(it->second.data(), it->second.length(), x);
+	}
+	else
+		return false;
+}
+
+bool csvdata::Search(const string& value, LI& row, LI& column, bool is_reset)
+{
+	if (is_reset)
+	{
+		row = 0;
+		column = 0;
+	}
+	if (isindex)
+	{
+		if (!isindexvalid)
+			_indexbuild();
+		auto found = csv_index.find(value);
+		if (found == csv_index.end())
+			return false;
+		auto& at = found->second.at;
+		if (found->second.isunsorted)
+		{
+			sort(at.begin(), at.end());
+			found->second.isunsorted = false;
+		}
+		auto it = lower_bound(at.begin(), at.end(), _index(row, column));
+		if (it == at.end())
+			return false;
+		row = _row(*it);
+		column = _column(*it);
+		return true;
+	}
+	for (map< LLI, string >::iterator it = csv_map.lower_bound(_index(row, column)); it != csv_map.end(); ++it)
+	{
+		if (strcmp(it->second.c_str(), value.c_str()) == 0)
+		{
+			LLI ind = it->first;
+			row = _row(ind);
+			column = _column(ind);
+			return true;
+		}
+	}
+	return false;
+}
+
+bool csvdata::Find(LI row, LI column, string& value)
+{
+	map< LLI, string >::iterator it = csv_map.find(_index(row, column));
+	if (it != csv_map.end())
+	{
+		value = it->second;
+		return true;
+	}
+	else
+	{
+		return false;
+	}
+}
+
+bool csvdata::LBElem(LI& row, LI& column, string& value)
+{
+	map< LLI, string >::iterator it = csv_map.lower_bound(_index(row, column));
+	if (it != csv_map.end())
+	{
+		LLI ind = it->first;
+		row = _row(ind);
+		column = _column(ind);
+		value = it->second;
+		return true;
+	}
+	else
+	{
+		return false;
+	}
+}
+
+bool csvdata::UBElem(LI& row, LI& column, string& value)
+{
+	map< LLI, string >::iterator it = csv_map.upper_bound(_index(row, column));
+	if (it != csv_map.end())
+	{
+		LLI ind = it->first;
+		row = _row(ind);
+		column = _column(ind);
+		value = it->second;
+		return true;
+	}
+	else
+	{
+		return false;
+	}
+}
+
+bool csvdata::BeginIter(map< LLI, string >::iterator& it)
+{
+	it = csv_map.begin();
+	return (it != csv_map.end());
+}
+
+bool csvdata::NextIter(map< LLI, string >::iterator& it)
+{
+	it++;
+	return (it != csv_map.end());
+}
+
+void csvdata::GetIter(map< LLI, string >::iterator& it, LI& row, LI& column, string& value)
+{
+	row = _row(it->first);
+	column = _column(it->first);
+	value = it->second;
+}
+
+// The index maps each value to the positions of the cells holding it.
+// SetCell and EraseCell keep it up to date: SetCell appends, so setting many
+// cells to a few values costs no more than setting them, and the positions of
+// a value are sorted on the next Search of it. Erasing a cell is linear in the
+// number of cells holding its value. Loading a file and the () operator (which
+// hands out a writable reference) mark it for a rebuild on the next Search.
+int csvdata::SetIndex(bool is_index)
+{
+	isindex = is_index;
+	csv_index.clear();
+	isindexvalid = false;
+	return 0;
+}
+
+void csvdata::_indexadd(LLI index, const string& value)
+{
+	auto& entry = csv_index[value];
+	if (!entry.at.empty() && (entry.at.back() > index))
+		entry.isunsorted = true;
+	entry.at.push_back(index);
+}
+
+void csvdata::_indexerase(LLI index, const string& value)
+{
+	auto found = csv_index.find(value);
+	if (found == csv_index.end())
+		return;
+	auto& at = found->second.at;
+	if (found->second.isunsorted)
+	{
+		auto it = find(at.begin(), at.end(), index);
+		if (it != at.end())
+		{
+			*it = at.back();
+			at.pop_back();
+		}
+	}
+	else
+	{
+		auto it = lower_bound(at.begin(), at.end(), index);
+		if ((it != at.end()) && (*it == index))
+			at.erase(it);
+	}
+	if (at.empty())
+		csv_index.erase(found);
+}
+
+void csvdata::_indexbuild()
+{
+	csv_index.clear();
+	for (auto& it : csv_map)
+		csv_index[it.second].at.push_back(it.first);
+	isindexvalid = true;
+}
+
+// A column is parsed once on its first GetCellDouble into a double per row and
+// a bitmap of the rows holding a number. SetCell and EraseCell update the entry
+// in place. A column with rows far beyond the number of cells is not cached.
+int csvdata::SetNumberCache(bool is_numbercache)
+{
+	isnumbercache = is_numbercache;
+	csv_numbers.clear();
+	return 0;
+}
+
+csvdata::numbercolumn* csvdata::_numbers(LI column)
+{
+	if (!isnumbercache)
+		return nullptr;
+	auto found = csv_numbers.find(column);
+	if (found != csv_numbers.end())
+		return found->second.isdense ? &found->second : nullptr;
+	numbercolumn& nc = csv_numbers[column];
+	size_t limit = 4 * csv_map.size() + 1024;
+	nc.isdense = true;
+	double x;
+	for (auto& it : csv_map)
+	{
+		if (_column(it.first) != column)
+			continue;
+		size_t row = _row(it.first);
+		if (row >= limit)
+		{
+			nc.isdense = false;
+			nc.values = vector< double >();
+			nc.isvalue = vector< uint64_t >();
+			return nullptr;
+		}
+		if (row >= nc.values.size())
+		{
+			nc.values.resize(row + 1);
+			nc.isvalue.resize((row >> 6) + 1);
+		}
+		if (StrDouble(it.second.data(), it.second.length(), x))
+		{
+			nc.values[row] = x;
+			nc.isvalue[row >> 6] |= 1ULL << (row & 63);
+		}
+	}
+	return &nc;
+}
+
+void csvdata::_numberset(LI row, LI column, const string& value)
+{
+	auto found = csv_numbers.find(column);
+	if ((found == csv_numbers.end()) || !found->second.isdense)
+		return;
+	numbercolumn& nc = found->second;
+	double x;
+	bool isvalue = (value.length() > 0) && StrDouble(value.data(), value.length(), x);
+	if (row >= nc.values.size())
+	{
+		if (!isvalue)
+			return;
+		if (row >= 4 * csv_map.size() + 1024)
+		{
+			csv_numbers.erase(found);
+			return;
+		}
+		nc.values.resize((size_t)row + 1);
+		nc.isvalue.resize(((size_t)row >> 6) + 1);
+	}
+	if (isvalue)
+	{
+		nc.values[row] = x;
+		nc.isvalue[row >> 6] |= 1ULL << (row & 63);
+	}
+	else
+	{
+		nc.values[row] = 0;
+		nc.isvalue[row >> 6] &= ~(1ULL << (row & 63));
+	}
+}
+
+// Reduces v[begin, end) where bit i of isvalue marks v[i] as a number. begin
+// is a multiple of 64 and v[i] is 0 where there is no number, so sums take
+// whole blocks. Min and max skip NaN values.
+void csvreduce(const double* v, const uint64_t* isvalue, size_t begin, size_t end, csvstats& s)
+{
+	const double inf = numeric_limits< double >::infinity();
+	size_t count = 0;
+	double sum = 0;
+	double mn = inf;
+	double mx = -inf;
+#if defined(__AVX2__)
+	__m256d sum0 = _mm256_setzero_pd(), sum1 = _mm256_setzero_pd();
+	__m256d mn0 = _mm256_set1_pd(inf), mx0 = _mm256_set1_pd(-inf);
+#elif defined(CSV_SSE2)
+	__m128d sum0 = _mm_setzero_pd(), sum1 = _mm_setzero_pd();
+	__m128d mn0 = _mm_set1_pd(inf), mx0 = _mm_set1_pd(-inf);
+#endif
+	for (size_t b = begin; b < end; b += 64)
+	{
+		size_t n = (end - b < 64) ? end - b : 64;
+		uint64_t bits = isvalue[b >> 6];
+		if (n < 64)
+			bits &= (1ULL << n) - 1;
+		if (bits == 0)
+			continue;
+		count += csvpopcount(bits);
+		const double* p = v + b;
+		if (n < 64)
+		{
+			for (size_t i = 0; i < n; i++)
+				sum += p[i];
+		}
+		else
+		{
+#if defined(__AVX2__)
+			for (size_t i = 0; i < 64; i += 8)
+			{
+				sum0 = _mm256_add_pd(sum0, _mm256_loadu_pd(p + i));
+				sum1 = _mm256_add_pd(sum1, _mm256_loadu_pd(p + i + 4));
+			}
+#elif defined(CSV_SSE2)
+			for (size_t i = 0; i < 64; i += 4)
+			{
+				sum0 = _mm_add_pd(sum0, _mm_loadu_pd(p + i));
+				sum1 = _mm_add_pd(sum1, _mm_loadu_pd(p + i + 2));
+			}
+#else
+			double s0 = 0, s1 = 0, s2 = 0, s3 = 0;
+			for (size_t i = 0; i < 64; i += 4)
+			{
+				s0 += p[i];
+				s1 += p[i + 1];
+				s2 += p[i + 2];
+				s3 += p[i + 3];
+			}
+			sum += (s0 + s1) + (s2 + s3);
+#endif
+		}
+		if (bits == ~0ULL)
+		{
+#if defined(__AVX2__)
+			for (size_t i = 0; i < 64; i += 4)
+			{
+				__m256d x = _mm256_loadu_pd(p + i);
+				mn0 = _mm256_min_pd(x, mn0);
+				mx0 = _mm256_max_pd(x, mx0);
+			}
+			continue;
+#elif defined(CSV_SSE2)
+			for (size_t i = 0; i < 64; i += 2)
+			{
+				__m128d x = _mm_loadu_pd(p + i);
+				mn0 = _mm_min_pd(x, mn0);
+				mx0 = _mm_max_pd(x, mx0);
+			}
+			continue;
+#endif
+		}
+		while (bits)
+		{
+			double x = p[csvctz(bits)];
+			if (x < mn)
+				mn = x;
+			if (x > mx)
+				mx = x;
+			bits &= bits - 1;
+		}
+	}
+#if defined(__AVX2__)
+	double t[4];
+	_mm256_storeu_pd(t, _mm256_add_pd(sum0, sum1));
+	sum += (t[0] + t[1]) + (t[2] + t[3]);
+	_mm256_storeu_pd(t, mn0);
+	for (int k = 0; k < 4; k++)
+		if (t[k] < mn)
+			mn = t[k];
+	_mm256_storeu_pd(t, mx0);
+	for (int k = 0; k < 4; k++)
+		if (t[k] > mx)
+			mx = t[k];
+#elif defined(CSV_SSE2)
+	double t[2];
+	_mm_storeu_pd(t, _mm_add_pd(sum0, sum1));
+	sum += t[0] + t[1];
+	_mm_storeu_pd(t, mn0);
+	for (int k = 0; k < 2; k++)
+		if (t[k] < mn)
+			mn = t[k];
+	_mm_storeu_pd(t, mx0);
+	for (int k = 0; k < 2; k++)
+		if (t[k] > mx)
+			mx = t[k];
+#endif
+	s.count = count;
+	s.sum = sum;
+	s.min = mn;
+	s.max = mx;
+}
+
+// Count, min and max are exact. The sum is added in blocks, vector lanes and
+// threads rather than row by row, so sum and mean may differ from a row by row
+// loop by rounding, at most about count * 2^-52 * (sum of |x|).
+int csvdata::ColumnStats(LI column, csvstats& stats, unsigned threads)
+{
+	numbercolumn tmp;
+	numbercolumn* nc = _numbers(column);
+	if (!nc)
+	{
+		// sparse or not cached: the numbers of the column one after another
+		double x;
+		for (auto& it : csv_map)
+			if ((_column(it.first) == column) && StrDouble(it.second.data(), it.second.length(), x))
+				tmp.values.push_back(x);
+		tmp.isvalue.assign((tmp.values.size() + 63) >> 6, ~0ULL);
+		nc = &tmp;
+	}
+	size_t n = nc->values.size();
+
+	const size_t minchunk = 1 << 16;
+	if (threads == 0)
+		threads = thread::hardware_concurrency();
+	if (threads > n / minchunk)
+		threads = (unsigned)(n / minchunk);
+	if (threads == 0)
+		threads = 1;
+
+	vector< csvstats > part(threads);
+	size_t chunk = ((n / threads + 63) >> 6) << 6;
+	auto work = [&](unsigned k)
+	{
+		size_t begin = min(n, k * chunk);
+		size_t end = (k + 1 == threads) ? n : min(n, (k + 1) * chunk);
+		csvreduce(nc->values.data(), nc->isvalue.data(), begin, end, part[k]);
+	};
+	vector< thread > pool;
+	for (unsigned k = 1; k < threads; k++)
+		pool.emplace_back(work, k);
+	work(0);
+	for (auto& th : pool)
+		th.join();
+
+	stats = part[0];
+	for (unsigned k = 1; k < threads; k++)
+	{
+		stats.count += part[k].count;
+		stats.sum += part[k].sum;
+		if (part[k].min < stats.min)
+			stats.min = part[k].min;
+		if (part[k].max > stats.max)
+			stats.max = part[k].max;
+	}
+	if (stats.count == 0)
+	{
+		stats.sum = stats.min = stats.max = stats.mean = 0;
+		return 1;
+	}
+	stats.mean = stats.sum / stats.count;
+	return 0;
+}
+
+// Sort key of a number: the unsigned order of keys is the order of numbers.
+// Values that are not numbers get ~0 and sort last.
+inline uint64_t csvsortkey(const string& value, bool isdescending)
+{
+	double x;
+	if (!StrDouble(value.data(), value.length(), x) || (x != x))
+		return ~0ULL;
+	if (x == 0)
+		x = 0;
+	uint64_t u;
+	memcpy(&u, &x, sizeof(u));
+	u = (u >> 63) ? ~u : (u | (1ULL << 63));
+	return isdescending ? ~u : u;
+}
+
+// Stable LSD radix sort of rows, keys[i] being the key of rows[i], a byte at
+// a time. Each thread counts and then scatters its own part of the keys, so
+// equal keys keep their order. Bytes that are the same in all keys are skipped.
+void csvradixsort(vector< uint64_t >& keys, vector< LI >& rows, unsigned threads)
+{
+	size_t n = keys.size();
+	size_t chunk = (n + threads - 1) / threads;
+	vector< uint64_t > keys2(n);
+	vector< LI > rows2(n);
+	vector< size_t > count(threads * 256);
+	auto parallel = [&](auto work)
+	{
+		vector< thread > pool;
+		for (unsigned k = 1; k < threads; k++)
+			pool.emplace_back(work, k);
+		work(0);
+		for (auto& th : pool)
+			th.join();
+	};
+	for (unsigned shift = 0; (shift < 64) && (n > 1); shift += 8)
+	{
+		parallel([&](unsigned k)
+		{
+			size_t* c = &count[k * 256];
+			fill(c, c + 256, 0);
+			for (size_t i = min(n, k * chunk); i < min(n, (k + 1) * chunk); i++)
+				c[(keys[i] >> shift) & 255]++;
+		});
+		size_t same = 0;
+		for (unsigned k = 0; k < threads; k++)
+			same += count[k * 256 + ((keys[0] >> shift) & 255)];
+		if (same == n)
+			continue;
+
+		size_t sum = 0;
+		for (unsigned d = 0; d < 256; d++)
+			for (unsigned k = 0; k < threads; k++)
+			{
+				size_t c = count[k * 256 + d];
+				count[k * 256 + d] = sum;
+				sum += c;
+			}
+		parallel([&](unsigned k)
+		{
+			size_t* c = &count[k * 256];
+			for (size_t i = min(n, k * chunk); i < min(n, (k + 1) * chunk); i++)
+			{
+				size_t p = c[(keys[i] >> shift) & 255]++;
+				keys2[p] = keys[i];
+				rows2[p] = rows[i];
+			}
+		});
+		keys.swap(keys2);
+		rows.swap(rows2);
+	}
+}
+
+// Stable merge sort of rows: each thread sorts a part, then pairs of sorted
+// runs are merged, the pairs of one round in parallel.
+template < class L >
+void csvmergesort(vector< LI >& rows, L less, unsigned threads)
+{
+	size_t n = rows.size();
+	size_t chunk = (n + threads - 1) / threads;
+	auto parallel = [&](auto work)
+	{
+		vector< thread > pool;
+		for (unsigned k = 1; k < threads; k++)
+			pool.emplace_back(work, k);
+		work(0);
+		for (auto& th : pool)
+			th.join();
+	};
+	parallel([&](unsigned k)
+	{
+		stable_sort(rows.begin() + min(n, k * chunk), rows.begin() + min(n, (k + 1) * chunk), less);
+	});
+	vector< LI > merged(n);
+	for (size_t width = chunk; width < n; width *= 2)
+	{
+		size_t pairs = (n + 2 * width - 1) / (2 * width);
+		parallel([&](unsigned k)
+		{
+			for (size_t j = k; j < pairs; j += threads)
+			{
+				auto begin = rows.begin() + j * 2 * width;
+				auto middle = rows.begin() + min(n, j * 2 * width + width);
+				auto end = rows.begin() + min(n, (j + 1) * 2 * width);
+				merge(begin, middle, middle, end, merged.begin() + j * 2 * width, less);
+			}
+		});
+		rows.swap(merged);
+	}
+}
+
+// The keys are read in the same pass over the cells that finds the rows that
+// have cells and where each starts, so the work and memory follow the cells
+// and not the row numbers. The sort gives the old row of each new row, and the
+// cells are then moved to their new rows in order, as map nodes, so no value is
+// copied. Row numbers without cells sort as rows with empty keys would: they
+// are not stored, only counted, to give the rows after them their numbers.
+int csvdata::SortRows(const vector< LI >& columns, bool isdescending, bool isnumeric, LI firstrow, unsigned threads)
+{
+	if (columns.empty())
+		return 1;
+	if (csv_map.empty() || (_row(csv_map.rbegin()->first) < firstrow))
+		return 0;
+	LI last = _row(csv_map.rbegin()->first);
+	size_t k = columns.size();
+
+	vector< LI > rownumbers;
+	vector< iterator > first;
+	vector< uint64_t > numberkeys;
+	vector< string_view > textkeys;
+	for (auto it = csv_map.lower_bound(_index(firstrow, 0)); it != csv_map.end(); ++it)
+	{
+		LI row = _row(it->first);
+		if (rownumbers.empty() || (rownumbers.back() != row))
+		{
+			rownumbers.push_back(row);
+			first.push_back(it);
+			if (isnumeric)
+				numberkeys.resize(numberkeys.size() + k, ~0ULL);
+			else
+				textkeys.resize(textkeys.size() + k);
+		}
+		size_t i = rownumbers.size() - 1;
+		LI column = _column(it->first);
+		for (size_t j = 0; j < k; j++)
+		{
+			if (columns[j] != column)
+				continue;
+			if (isnumeric)
+				numberkeys[i * k + j] = csvsortkey(it->second, isdescending);
+			else
+				textkeys[i * k + j] = it->second;
+		}
+	}
+	size_t m = rownumbers.size();
+
+	const size_t minchunk = 1 << 16;
+	if (threads == 0)
+		threads = thread::hardware_concurrency();
+	if (threads > m / minchunk)
+		threads = (unsigned)(m / minchunk);
+	if (threads == 0)
+		threads = 1;
+
+	vector< LI > rows(m);
+	for (size_t i = 0; i < m; i++)
+		rows[i] = (LI)i;
+	if (isnumeric)
+	{
+		// by the last column first, each pass keeping the order of the one before
+		vector< uint64_t > keys(m);
+		for (size_t j = k; j-- > 0; )
+		{
+			for (size_t i = 0; i < m; i++)
+				keys[i] = numberkeys[rows[i] * k + j];
+			csvradixsort(keys, rows, threads);
+		}
+	}
+	else
+	{
+		csvmergesort(rows, [&](LI a, LI b)
+		{
+			const string_view* x = &textkeys[a * k];
+			const string_view* y = &textkeys[b * k];
+			for (size_t j = 0; j < k; j++)
+				if (x[j] != y[j])
+					return isdescending ? (x[j] > y[j]) : (x[j] < y[j]);
+			return false;
+		}, threads);
+	}
+
+	// The rows without cells have the empty key and go with the rows from
+	// low to high of that key, in the order of their row numbers.
+	auto compare = [&](LI i) // of the key of rows[i] to the empty key
+	{
+		for (size_t j = 0; j < k; j++)
+		{
+			if (isnumeric)
+			{
+				if (numberkeys[i * k + j] != ~0ULL)
+					return -1;
+			}
+			else if (!textkeys[i * k + j].empty())
+				return isdescending ? -1 : 1;
+		}
+		return 0;
+	};
+	size_t low = partition_point(rows.begin(), rows.end(), [&](LI i) { return compare(i) < 0; }) - rows.begin();
+	size_t high = partition_point(rows.begin() + low, rows.end(), [&](LI i) { return compare(i) == 0; }) - rows.begin();
+	LI gaps = (LI)(last - firstrow + 1 - m);
+
+	map< LLI, string > sorted;
+	auto move_row = [&](iterator it, LI row)
+	{
+		LI from = _row(it->first);
+		for (;;)
+		{
+			auto next = std::next(it);
+			bool ismore = (next != csv_map.end()) && (_row(next->first) == from);
+			auto node = csv_map.extract(it);
+			node.key() = _index(row, _column(node.key()));
+			sorted.insert(sorted.end(), move(node));
+			if (!ismore)
+				break;
+			it = next;
+		}
+	};
+	while (!csv_map.empty() && (_row(csv_map.begin()->first) < firstrow))
+		move_row(csv_map.begin(), _row(csv_map.begin()->first));
+	for (size_t p = 0; p < m; p++)
+	{
+		LI i = rows[p];
+		LI row = (LI)(firstrow + p);
+		if (p >= high)
+			row += gaps;
+		else if (p >= low)
+			row += (LI)(rownumbers[i] - firstrow - i); // the rows without cells before it
+		move_row(first[i], row);
+	}
+	csv_map.swap(sorted);
+	isindexvalid = false;
+	csv_numbers.clear();
+	return 0;
+}
+
+// values as one string, each value after its length
+inline void csvkey(string& key, const vector< string_view >& values)
+{
+	key.clear();
+	for (auto& v : values)
+	{
+		key += to_string(v.size());
+		key += ':';
+		key.append(v.data(), v.size());
+	}
+}
+
+// For each row that has cells, in order: where the row starts and the values
+// of its keys columns as one csvkey string (empty for a row without cells in
+// the keys columns); and the number of columns
+void csvdata::_rowkeys(const vector< LI >& keys, vector< string >& rowkeys, vector< iterator >& first, LI& width)
+{
+	rowkeys.clear();
+	first.clear();
+	width = 0;
+
+	vector< string_view > values(keys.size());
+	auto put = [&]()
+	{
+		rowkeys.emplace_back();
+		if (any_of(values.begin(), values.end(), [](string_view v) { return !v.empty(); }))
+			csvkey(rowkeys.back(), values);
+		fill(values.begin(), values.end(), string_view());
+	};
+	for (auto it = csv_map.begin(); it != csv_map.end(); ++it)
+	{
+		LI row = _row(it->first);
+		LI column = _column(it->first);
+		if (first.empty() || (_row(first.back()->first) != row))
+		{
+			if (!first.empty())
+				put();
+			first.push_back(it);
+		}
+		if (column >= width)
+			width = column + 1;
+		for (size_t j = 0; j < keys.size(); j++)
+			if (keys[j] == column)
+				values[j] = it->second;
+	}
+	if (!first.empty())
+		put();
+}
+
+// A hash join. The smaller table is built into one hash table per thread,
+// each holding the keys that hash to it, and the rows of the other table are
+// probed in parallel parts. Only the rows that have cells are read, so row
+// numbers without cells cost nothing and, with isleft, give no row of output.
+// Rows of output are in the order of the rows of csv, and then of the rows of
+// other. A row without cells in its keys columns matches no row; an empty cell
+// in a key that has other cells is an empty value.
+int csvdata::Join(csvdata& other, const vector< LI >& keys, const vector< LI >& otherkeys, const vector< LI >& columns, csvdata& output, bool isleft, unsigned threads)
+{
+	if (keys.empty() || (keys.size() != otherkeys.size()) || (&output == this) || (&output == &other))
+		return 1;
+	vector< string > leftkeys;
+	vector< string > rightkeys;
+	vector< iterator > first;
+	vector< iterator > otherfirst;
+	LI width;
+	LI otherwidth;
+	_rowkeys(keys, leftkeys, first, width);
+	other._rowkeys(otherkeys, rightkeys, otherfirst, otherwidth);
+
+	bool isbuildleft = leftkeys.size() < rightkeys.size();
+	vector< string >& build = isbuildleft ? leftkeys : rightkeys;
+	vector< string >& probe = isbuildleft ? rightkeys : leftkeys;
+
+	const size_t minchunk = 1 << 16;
+	if (threads == 0)
+		threads = thread::hardware_concurrency();
+	if (threads > probe.size() / minchunk)
+		threads = (unsigned)(probe.size() / minchunk);
+	if (threads == 0)
+		threads = 1;
+	auto parallel = [&](auto work)
+	{
+		vector< thread > pool;
+		for (unsigned k = 1; k < threads; k++)
+			pool.emplace_back(work, k);
+		work(0);
+		for (auto& th : pool)
+			th.join();
+	};
+
+	hash< string_view > hasher;
+	vector< size_t > hashes(build.size());
+	size_t chunk = (build.size() + threads - 1) / threads;
+	parallel([&](unsigned k)
+	{
+		for (size_t i = min(build.size(), k * chunk); i < min(build.size(), (k + 1) * chunk); i++)
+			hashes[i] = hasher(build[i]);
+	});
+	vector< unordered_map< string_view, vector< LI > > > tables(threads);
+	parallel([&](unsigned k)
+	{
+		for (size_t i = 0; i < build.size(); i++)
+			if ((hashes[i] % threads == k) && !build[i].empty())
+				tables[k][build[i]].push_back((LI)i);
+	});
+
+	// the matching rows, (row of csv, row of other)
+	vector< vector< pair< LI, LI > > > found(threads);
+	chunk = (probe.size() + threads - 1) / threads;
+	parallel([&](unsigned k)
+	{
+		for (size_t i = min(probe.size(), k * chunk); i < min(probe.size(), (k + 1) * chunk); i++)
+		{
+			string_view key = probe[i];
+			if (key.empty())
+				continue;
+			auto& table = tables[hasher(key) % threads];
+			auto it = table.find(key);
+			if (it == table.end())
+				continue;
+			for (LI b : it->second)
+				found[k].push_back(isbuildleft ? make_pair(b, (LI)i) : make_pair((LI)i, b));
+		}
+	});
+	vector< pair< LI, LI > > pairs;
+	for (auto& part : found)
+		pairs.insert(pairs.end(), part.begin(), part.end());
+	if (isbuildleft)
+		stable_sort(pairs.begin(), pairs.end(), [](const pair< LI, LI >& a, const pair< LI, LI >& b) { return a.first < b.first; });
+
+	output.Clear();
+	LI row = 0;
+	auto emit = [&](LI left, LI right, bool ismatch)
+	{
+		LI leftrow = _row(first[left]->first);
+		for (auto it = first[left]; (it != csv_map.end()) && (_row(it->first) == leftrow); ++it)
+			output.csv_map.emplace_hint(output.csv_map.end(), _index(row, _column(it->first)), it->second);
+		for (size_t j = 0; ismatch && (j < columns.size()); j++)
+		{
+			auto it = other.csv_map.find(_index(_row(otherfirst[right]->first), columns[j]));
+			if (it != other.csv_map.end())
+				output.csv_map.emplace_hint(output.csv_map.end(), _index(row, (LI)(width + j)), it->second);
+		}
+		row++;
+	};
+	size_t p = 0;
+	for (size_t left = 0; left < leftkeys.size(); left++)
+	{
+		bool ismatch = false;
+		for (; (p < pairs.size()) && (pairs[p].first == left); p++)
+		{
+			emit((LI)left, pairs[p].second, true);
+			ismatch = true;
+		}
+		if (!ismatch && isleft)
+			emit((LI)left, 0, false);
+	}
+	output.isindexvalid = false;
+	return 0;
+}
+
+// Hash aggregation for GroupBy: the cells of a row are given with Cell, then
+// Row adds the row to the group of its keys.
+struct csvaggregate
+{
+	const vector< LI >& keys;
+	const vector< LI >& columns;
+	unordered_map< string, size_t > index;
+	vector< csvgroup > groups;
+	// the first row of each group, to put them in order
+	vector< size_t > first;
+	vector< string_view > keyvalues;
+	vector< string_view > values;
+	string key;
+	csvaggregate(const vector< LI >& k, const vector< LI >& c) : keys(k), columns(c), keyvalues(k.size()), values(c.size())
+	{
+
+	}
+	void Cell(LI column, string_view value)
+	{
+		for (size_t j = 0; j < keys.size(); j++)
+			if (keys[j] == column)
+				keyvalues[j] = value;
+		for (size_t j = 0; j < columns.size(); j++)
+			if (columns[j] == column)
+				values[j] = value;
+	}
+	size_t _group(const string& k, size_t row)
+	{
+		auto it = index.find(k);
+		if (it != index.end())
+			return it->second;
+		index.emplace(k, groups.size());
+		groups.emplace_back();
+		csvgroup& g = groups.back();
+		g.rows = 0;
+		csvstats s = { 0, 0, numeric_limits< double >::infinity(), -numeric_limits< double >::infinity(), 0 };
+		g.stats.assign(columns.size(), s);
+		first.push_back(row);
+		return groups.size() - 1;
+	}
+	void Row(size_t row)
+	{
+		csvkey(key, keyvalues);
+		size_t n = groups.size();
+		csvgroup& g = groups[_group(key, row)];
+		if (groups.size() > n)
+			for (auto& v : keyvalues)
+				g.keys.emplace_back(v);
+		g.rows++;
+		double x;
+		for (size_t j = 0; j < columns.size(); j++)
+		{
+			if (!StrDouble(values[j].data(), values[j].size(), x))
+				continue;
+			csvstats& s = g.stats[j];
+			s.count++;
+			s.sum += x;
+			if (x < s.min)
+				s.min = x;
+			if (x > s.max)
+				s.max = x;
+		}
+		fill(keyvalues.begin(), keyvalues.end(), string_view());
+		fill(values.begin(), values.end(), string_view());
+	}
+	void Merge(csvaggregate& other)
+	{
+		for (auto& it : other.index)
+		{
+			csvgroup& from = other.groups[it.second];
+			size_t n = groups.size();
+			size_t k = _group(it.first, other.first[it.second]);
+			csvgroup& g = groups[k];
+			if (groups.size() > n)
+				g.keys = from.keys;
+			first[k] = min(first[k], other.first[it.second]);
+			g.rows += from.rows;
+			for (size_t j = 0; j < columns.size(); j++)
+			{
+				g.stats[j].count += from.stats[j].count;
+				g.stats[j].sum += from.stats[j].sum;
+				g.stats[j].min = min(g.stats[j].min, from.stats[j].min);
+				g.stats[j].max = max(g.stats[j].max, from.stats[j].max);
+			}
+		}
+	}
+	void Finish(vector< csvgroup >& result)
+	{
+		vector< size_t > order(groups.size());
+		for (size_t k = 0; k < order.size(); k++)
+			order[k] = k;
+		sort(order.begin(), order.end(), [&](size_t a, size_t b) { return first[a] < first[b]; });
+		result.clear();
+		result.reserve(groups.size());
+		for (size_t k : order)
+		{
+			result.push_back(move(groups[k]));
+			for (auto& s : result.back().stats)
+			{
+				if (s.count == 0)
+					s.sum = s.min = s.max = s.mean = 0;
+				else
+					s.mean = s.sum / s.count;
+			}
+		}
+	}
+};
+
+// Each thread aggregates a range of rows into its own groups, which are then
+// merged into the groups of the first thread.
+int csvdata::GroupBy(const vector< LI >& keys, const vector< LI >& columns, vector< csvgroup >& groups, unsigned threads)
+{
+	groups.clear();
+	if (csv_map.empty())
+		return 0;
+	size_t n = (size_t)_row(csv_map.rbegin()->first) + 1;
+
+	const size_t minchunk = 1 << 16;
+	if (threads == 0)
+		threads = thread::hardware_concurrency();
+	if (threads > n / minchunk)
+		threads = (unsigned)(n / minchunk);
+	if (threads == 0)
+		threads = 1;
+
+	vector< csvaggregate > parts(threads, csvaggregate(keys, columns));
+	size_t chunk = (n + threads - 1) / threads;
+	auto work = [&](unsigned k)
+	{
+		csvaggregate& a = parts[k];
+		size_t end = min(n, (k + 1) * chunk);
+		auto it = csv_map.lower_bound(_index((LI)min(n, k * chunk), 0));
+		if ((it == csv_map.end()) || (_row(it->first) >= end))
+			return;
+		LI current = _row(it->first);
+		for (; (it != csv_map.end()) && (_row(it->first) < end); ++it)
+		{
+			LI row = _row(it->first);
+			if (row != current)
+			{
+				a.Row(current);
+				current = row;
+			}
+			a.Cell(_column(it->first), it->second);
+		}
+		a.Row(current);
+	};
+	vector< thread > pool;
+	for (unsigned k = 1; k < threads; k++)
+		pool.emplace_back(work, k);
+	work(0);
+	for (auto& th : pool)
+		th.join();
+
+	for (unsigned k = 1; k < threads; k++)
+		parts[0].Merge(parts[k]);
+	parts[0].Finish(groups);
+	return 0;
+}
+
+/****************************************************************************/
+
+int csvdata::Clear()
+{
+	csv_map.clear();
+	csv_index.clear();
+	isindexvalid = true;
+	csv_numbers.clear();
+	tailname.clear();
+	tailoffset = 0;
+	tailrow = 0;
+	tailcolumn = 0;
+	return 0;
+}
+
+string& csvdata::operator() (const LI row, const LI column)
+{
+	isindexvalid = false;
+	csv_numbers.erase(column);
+	return csv_map[_index(row, column)];
+}
+
+/****************************************************************************/
+
+csvcolumns::csvcolumns()
+{
+	rows = 0;
+}
+
+csvcolumns::~csvcolumns()
+{
+	Clear();
+}
+
+// days from 1970-01-01 of a date and back, in the proleptic Gregorian calendar
+inline int64_t csvdays(int64_t y, unsigned m, unsigned d)
+{
+	y -= (m <= 2);
+	int64_t era = (y >= 0 ? y : y - 399) / 400;
+	unsigned yoe = (unsigned)(y - era * 400);
+	unsigned doy = (153 * (m > 2 ? m - 3 : m + 9) + 2) / 5 + d - 1;
+	unsigned doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+	return era * 146097 + (int64_t)doe - 719468;
+}
+
+inline void csvcivil(int64_t days, int64_t& y, unsigned& m, unsigned& d)
+{
+	days += 719468;
+	int64_t era = (days >= 0 ? days : days - 146096) / 146097;
+	unsigned doe = (unsigned)(days - era * 146097);
+	unsigned yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+	unsigned doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+	unsigned mp = (5 * doy + 2) / 153;
+	d = doy - (153 * mp + 2) / 5 + 1;
+	m = (mp < 10) ? mp + 3 : mp - 9;
+	y = (int64_t)yoe + era * 400 + (m <= 2);
+}
+
+// the text of a value of a typed column, in buf of 40 chars; 0 if it does not fit
+size_t csvcolumns::_format(const column& c, int64_t i, double x, char* buf)
+{
+	to_chars_result res;
+	switch (c.type)
+	{
+	case csvint:
+		res = to_chars(buf, buf + 40, i);
+		break;
+	case csvdouble:
+		res = (c.decimals < 0) ? to_chars(buf, buf + 40, x) : to_chars(buf, buf + 40, x, chars_format::fixed, c.decimals);
+		break;
+	case csvdate:
+	{
+		int64_t y;
+		unsigned m;
+		unsigned d;
+		csvcivil(i, y, m, d);
+		if ((y < 0) || (y > 9999))
+			return 0;
+		unsigned v[3] = { (unsigned)y, m, d };
+		char* p = buf;
+		for (int k = 0; k < 3; k++)
+		{
+			for (int w = (k == 0) ? 1000 : 10; w > 0; w /= 10)
+				*p++ = (char)('0' + v[k] / w % 10);
+			*p++ = '-';
+		}
+		return 10;
+	}
+	case csvbool:
+		memcpy(buf, i ? (c.isupper ? "TRUE" : "true") : (c.isupper ? "FALSE" : "false"), 5);
+		return i ? 4 : 5;
+	default:
+		return 0;
+	}
+	return (res.ec == errc()) ? (size_t)(res.ptr - buf) : 0;
+}
+
+// the value of text s for the type of c, true only if the type writes the
+// value back as the same text, so typed columns keep cells as they were
+bool csvcolumns::_parse(const column& c, const char* s, size_t n, int64_t& i, double& x)
+{
+	switch (c.type)
+	{
+	case csvint:
+		if (from_chars(s, s + n, i).ptr != s + n)
+			return false;
+		break;
+	case csvdouble:
+		if ((n > 32) || (from_chars(s, s + n, x).ptr != s + n))
+			return false;
+		break;
+	case csvdate:
+	{
+		if ((n != 10) || (s[4] != '-') || (s[7] != '-'))
+			return false;
+		unsigned v[3] = { 0, 0, 0 };
+		for (size_t k = 0; k < n; k++)
+		{
+			if ((k == 4) || (k == 7))
+				continue;
+			if ((s[k] < '0') || (s[k] > '9'))
+				return false;
+			v[(k > 4) + (k > 7)] = v[(k > 4) + (k > 7)] * 10 + (unsigned)(s[k] - '0');
+		}
+		if ((v[1] < 1) || (v[1] > 12) || (v[2] < 1) || (v[2] > 31))
+			return false;
+		i = csvdays(v[0], v[1], v[2]);
+		break;
+	}
+	case csvbool:
+		if ((n == 4) && (memcmp(s, c.isupper ? "TRUE" : "true", 4) == 0))
+			i = 1;
+		else if ((n == 5) && (memcmp(s, c.isupper ? "FALSE" : "false", 5) == 0))
+			i = 0;
+		else
+			return false;
+		break;
+	default:
+		return false;
+	}
+	char buf[40];
+	return (_format(c, i, x, buf) == n) && (memcmp(buf, s, n) == 0);
+}
+
+// makes a typed column a string column
+void csvcolumns::_totext(column& c)
+{
+	column t = column();
+	t.offsets.push_back(0);
+	char buf[40];
+	size_t size = (c.type == csvdouble) ? c.numbers.size() : c.integers.size();
+	for (size_t r = 0; r < max(size, c.head.size()); r++)
+	{
+		if (r < c.headrows)
+		{
+			if (r < c.head.size())
+				t.chars += c.head[r];
+		}
+		else if ((r < size) && ((c.isvalue[r >> 6] >> (r & 63)) & 1))
+			t.chars.append(buf, _format(c, (c.type == csvdouble) ? 0 : c.integers[r], (c.type == csvdouble) ? c.numbers[r] : 0, buf));
+		t.offsets.push_back(t.chars.size());
+	}
+	while ((t.offsets.size() > 1) && (t.offsets[t.offsets.size() - 1] == t.offsets[t.offsets.size() - 2]))
+		t.offsets.pop_back();
+	t.type = csvstring;
+	t.nulls = c.nulls;
+	c = move(t);
+}
+
+// s and n are the cell, in buf (40 chars) for typed columns
+bool csvcolumns::_cell(LI row, LI column, const char*& s, size_t& n, char* buf)
+{
+	if (column >= columns.size())
+		return false;
+	auto& c = columns[column];
+	if (c.type != csvstring)
+	{
+		if (!_has(row, column))
+			return false;
+		if (row < c.headrows)
+		{
+			s = c.head[row].data();
+			n = c.head[row].length();
+			return true;
+		}
+		s = buf;
+		n = _format(c, (c.type == csvdouble) ? 0 : c.integers[row], (c.type == csvdouble) ? c.numbers[row] : 0, buf);
+		return true;
+	}
+	if ((size_t)row + 1 >= c.offsets.size())
+		return false;
+	s = c.chars.data() + c.offsets[row];
+	n = (size_t)(c.offsets[row + 1] - c.offsets[row]);
+	return (n > 0);
+}
+
+bool csvcolumns::_has(LI row, LI column)
+{
+	if (column >= columns.size())
+		return false;
+	auto& c = columns[column];
+	if (c.type == csvstring)
+		return ((size_t)row + 1 < c.offsets.size()) && (c.offsets[row + 1] > c.offsets[row]);
+	if (row < c.headrows)
+		return (row < c.head.size()) && !c.head[row].empty();
+	size_t size = (c.type == csvdouble) ? c.numbers.size() : c.integers.size();
+	return (row < size) && ((c.isvalue[row >> 6] >> (row & 63)) & 1);
+}
+
+void csvcolumns::_set(LI row, LI column, const char* s, size_t n)
+{
+	if (column >= columns.size())
+	{
+		if (n == 0)
+			return;
+		columns.resize((size_t)column + 1);
+	}
+	auto& c = columns[column];
+	if ((c.type != csvstring) && (row < c.headrows))
+	{
+		if (row >= c.head.size())
+		{
+			if (n == 0)
+				return;
+			c.head.resize((size_t)row + 1);
+		}
+		c.head[row].assign(s, n);
+		if ((n > 0) && (row >= rows))
+			rows = row + 1;
+		return;
+	}
+	if (c.type != csvstring)
+	{
+		size_t size = (c.type == csvdouble) ? c.numbers.size() : c.integers.size();
+		if (n == 0)
+		{
+			if (row < size)
+				c.isvalue[row >> 6] &= ~(1ULL << (row & 63));
+			return;
+		}
+		int64_t i = 0;
+		double x = 0;
+		if (_parse(c, s, n, i, x))
+		{
+			if (row >= size)
+			{
+				if (c.type == csvdouble)
+					c.numbers.resize((size_t)row + 1);
+				else
+					c.integers.resize((size_t)row + 1);
+				c.isvalue.resize(((size_t)row + 64) >> 6);
+				if (row >= rows)
+					rows = row + 1;
+			}
+			if (c.type == csvdouble)
+				c.numbers[row] = x;
+			else
+				c.integers[row] = i;
+			c.isvalue[row >> 6] |= 1ULL << (row & 63);
+			return;
+		}
+		_totext(c);
+	}
+	if (c.offsets.empty())
+		c.offsets.push_back(0);
+
+	// append, the usual case when loading
+	if ((size_t)row + 1 >= c.offsets.size())
+	{
+		if (n == 0)
+			return;
+		c.offsets.resize((size_t)row + 1, c.offsets.back());
+		c.chars.append(s, n);
+		c.offsets.push_back(c.chars.size());
+		if (row >= rows)
+			rows = row + 1;
+		return;
+	}
+
+	LLI b = c.offsets[row];
+	LLI e = c.offsets[row + 1];
+	c.chars.replace((size_t)b, (size_t)(e - b), s, n);
+	if (n != e - b)
+		for (size_t r = (size_t)row + 1; r < c.offsets.size(); r++)
+			c.offsets[r] = c.offsets[r] + n - (e - b);
+	while ((c.offsets.size() > 1) && (c.offsets[c.offsets.size() - 1] == c.offsets[c.offsets.size() - 2]))
+		c.offsets.pop_back();
+}
+
+// finds the first non-empty cell at or after (row, column) in row order
+bool csvcolumns::_seek(LLI row, LLI column, LI& r, LI& c)
+{
+	for (; row < rows; row++, column = 0)
+		for (; column < columns.size(); column++)
+			if (_has((LI)row, (LI)column))
+			{
+				r = (LI)row;
+				c = (LI)column;
+				return true;
+			}
+	return false;
+}
+
+// stores the scanned cells in columns
+struct csvcolumns::columninserter
+{
+	csvcolumns& csv;
+	void cell(LI row, LI column, const char* s, size_t n)
+	{
+		csv._set(row, column, s, n);
+	}
+	bool endrow(size_t)
+	{
+		return true;
+	}
+};
+
+// keeps, for each column, the types that fit all of its cells so far from
+// firstrow; rows counts the ended rows and end is past the last row seen, for
+// a last row without a line end
+struct csvcolumns::sampler
+{
+	csvcolumns& csv;
+	vector< vector< column > > fits;
+	vector< size_t > cells;
+	LI rows;
+	LI end;
+	LI samplerows;
+	LI firstrow;
+	void cell(LI row, LI column, const char* s, size_t n)
+	{
+		if (row >= end)
+			end = row + 1;
+		if ((n == 0) || (row < firstrow))
+			return;
+		if (column >= fits.size())
+		{
+			fits.resize((size_t)column + 1);
+			cells.resize((size_t)column + 1);
+		}
+		auto& f = fits[column];
+		if (cells[column]++ == 0)
+		{
+			// in order of preference; a fixed number of decimals from the first cell
+			const char* point = (const char*)memchr(s, '.', n);
+			size_t decimals = point ? (size_t)(s + n - point - 1) : 0;
+			f.resize(6);
+			f[0].type = f[1].type = csvbool;
+			f[1].isupper = true;
+			f[2].type = csvint;
+			f[3].type = csvdate;
+			f[4].type = f[5].type = csvdouble;
+			f[4].decimals = (decimals > 0) && (decimals < 30) ? (int)decimals : -1;
+			f[5].decimals = -1;
+		}
+		int64_t i;
+		double x;
+		f.erase(remove_if(f.begin(), f.end(), [&](auto& c) { return !csv._parse(c, s, n, i, x); }), f.end());
+	}
+	bool endrow(size_t)
+	{
+		++rows;
+		return (rows <= firstrow) || (rows - firstrow < samplerows);
+	}
+};
+
+// With isinfer the types are chosen before the load, for the columns that are
+// still empty, so values are parsed as they are stored.
+int csvcolumns::LoadFile(const char* filename, bool isclear, bool isinfer, LI samplerows, LI firstrow)
+{
+	if (isclear)
+		Clear();
+
+	csvmapfile file;
+	if (file.Open(filename) != 0)
+		return 1;
+
+	LI row = 0;
+	LI column = 0;
+	if (isinfer && (samplerows > 0))
+	{
+		sampler s = { *this, {}, {}, 0, 0, samplerows, firstrow };
+		csvscan(file.data, file.size, row, column, true, s);
+		LI sampled = max(s.rows, s.end);
+		sampled = (sampled > firstrow) ? sampled - firstrow : 0;
+		if (s.fits.size() > columns.size())
+			columns.resize(s.fits.size());
+		for (size_t k = 0; k < s.fits.size(); k++)
+		{
+			auto& c = columns[k];
+			if ((c.type != csvstring) || (c.offsets.size() > 1))
+				continue;
+			c.nulls = (sampled > s.cells[k]) ? (double)(sampled - s.cells[k]) / sampled : 0;
+			if (!s.fits[k].empty())
+			{
+				c.type = s.fits[k][0].type;
+				c.decimals = s.fits[k][0].decimals;
+				c.isupper = s.fits[k][0].isupper;
+				c.headrows = firstrow;
+				c.offsets.clear();
+			}
+		}
+		row = 0;
+		column = 0;
+	}
+	columninserter h = { *this };
+	csvscan(file.data, file.size, row, column, true, h);
+	return 0;
+}
+
+csvschema csvcolumns::GetSchema()
+{
+	csvschema schema;
+	for (auto& c : columns)
+	{
+		schema.types.push_back(c.type);
+		schema.nulls.push_back(c.nulls);
+	}
+	return schema;
+}
+
+int csvcolumns::SaveFile(const char* filename)
+{
+	return csvsave(*this, filename);
+}
+
+int csvcolumns::EraseCell(LI row, LI column)
+{
+	_set(row, column, nullptr, 0);
+	return 0;
+}
+
+int csvcolumns::SetCell(LI row, LI column, const string& value)
+{
+	_set(row, column, value.data(), value.length());
+	return (value.length() == 0) ? 1 : 0;
+}
+
+string csvcolumns::GetCell(LI row, LI column)
+{
+	const char* s;
+	size_t n;
+	char buf[40];
+	if (_cell(row, column, s, n, buf))
+		return string(s, n);
+	else
+		return "";
+}
+
+bool csvcolumns::GetCellDouble(LI row, LI column, double& x)
+{
+	if ((column < columns.size()) && ((columns[column].type == csvint) || (columns[column].type == csvdouble)) && (row >= columns[column].headrows))
+	{
+		if (!_has(row, column))
+			return false;
+		auto& c = columns[column];
+		x = (c.type == csvdouble) ? c.numbers[row] : (double)c.integers[row];
+		return true;
+	}
+	const char* s;
+	size_t n;
+	char buf[40];
+	if (_cell(row, column, s, n, buf))
+		return StrDouble(s, n, x);
+	else
+		return false;
+}
+
+bool csvcolumns::Search(const string& value, LI& row, LI& column, bool is_reset)
+{
+	if (is_reset)
+	{
+		row = 0;
+		column = 0;
+	}
+	const char* s;
+	size_t n;
+	char buf[40];
+	for (LLI r = row, c = column; r < rows; r++, c = 0)
+		for (; c < columns.size(); c++)
+			if (_cell((LI)r, (LI)c, s, n, buf) && (n == value.length()) && (memcmp(s, value.data(), n) == 0))
+			{
+				row = (LI)r;
+				column = (LI)c;
+				return true;
+			}
+	return false;
+}
+
+bool csvcolumns::Find(LI row, LI column, string& value)
+{
+	const char* s;
+	size_t n;
+	char buf[40];
+	if (_cell(row, column, s, n, buf))
+	{
+		value.assign(s, n);
+		return true;
+	}
+	else
+	{
+		return false;
+	}
+}
+
+bool csvcolumns::LBElem(LI& row, LI& column, string& value)
+{
+	if (_seek(row, column, row, column))
+	{
+		value = GetCell(row, column);
+		return true;
+	}
+	else
+	{
+		return false;
+	}
+}
+
+bool csvcolumns::UBElem(LI& row, LI& column, string& value)
+{
+	if (_seek(row, (LLI)column + 1, row, column))
+	{
+		value = GetCell(row, column);
+		return true;
+	}
+	else
+	{
+		return false;
+	}
+}
+
+bool csvcolumns::BeginIter(iterator& it)
+{
+	return _seek(0, 0, it.row, it.column);
+}
+
+bool csvcolumns::NextIter(iterator& it)
+{
+	return _seek(it.row, (LLI)it.column + 1, it.row, it.column);
+}
+
+void csvcolumns::GetIter(iterator& it, LI& row, LI& column, string& value)
+{
+	row = it.row;
+	column = it.column;
+	value = GetCell(row, column);
+}
+
+int csvcolumns::Clear()
+{
+	columns.clear();
+	rows = 0;
+	return 0;
+}
+
+/****************************************************************************/
+
+csvarena::csvarena()
+{
+	used = 0;
+	slabsize = 0;
+}
+
+const char* csvarena::Add(const char* s, size_t n)
+{
+	const size_t minslab = 1 << 20;
+	if (n > minslab / 4)
+	{
+		// large text gets a slab of its own, the current slab stays last
+		auto at = slabs.emplace(slabs.empty() ? slabs.end() : slabs.end() - 1, new char[n]);
+		memcpy(at->get(), s, n);
+		return at->get();
+	}
+	if (used + n > slabsize)
+	{
+		slabs.emplace_back(new char[minslab]);
+		slabsize = minslab;
+		used = 0;
+	}
+	char* p = slabs.back().get() + used;
+	memcpy(p, s, n);
+	used += n;
+	return p;
+}
+
+const char* csvarena::Intern(const char* s, size_t n)
+{
+	auto it = strings.find(string_view(s, n));
+	if (it != strings.end())
+		return it->data();
+	const char* p = Add(s, n);
+	strings.insert(string_view(p, n));
+	return p;
+}
+
+void csvarena::Clear()
+{
+	strings.clear();
+	slabs.clear();
+	used = 0;
+	slabsize = 0;
+}
+
+/****************************************************************************/
+
+LLI csvlazy::_index(LI row, LI column)
+{
+	return csvindex(row, column);
+}
+LI csvlazy::_row(LLI index)
+{
+	return csvrow(index);
+}
+LI csvlazy::_column(LLI index)
+{
+	return csvcolumn(index);
+}
+
+csvlazy::csvlazy()
+{
+
+}
+
+csvlazy::~csvlazy()
+{
+	Clear();
+}
+
+// Records the field as it is when it needs no unescaping: plain or wholly
+// quoted without inner quotes (only the quotes are cut). Other fields are
+// kept raw; one without any text byte may still decode to nothing, so only
+// such a field is decoded here to see if it is a cell.
+struct csvlazy::lazyinserter
+{
+	csvlazy& csv;
+	void rawcell(LI row, LI column, const char* b, const char* e, bool isplain)
+	{
+		slice c;
+		c.index = csv._index(row, column);
+		c.offset = b - csv.file.data;
+		c.n = (uint32_t)(e - b);
+		c.isescaped = 0;
+		if (!isplain)
+		{
+			if (csvquotedonly(b, e))
+			{
+				c.offset++;
+				c.n -= 2;
+			}
+			else
+			{
+				c.isescaped = 1;
+				const char* p = b;
+				while ((p < e) && ((*p == '"') || ((signed char)*p < 32)))
+					p++;
+				const char* s;
+				size_t n;
+				if ((p == e) && !csvfield(b, e, csv.tmp, s, n))
+					return;
+			}
+		}
+		csv.cells.push_back(c);
+	}
+	bool endrow(size_t)
+	{
+		return true;
+	}
+};
+
+int csvlazy::LoadFile(const char* filename)
+{
+	Clear();
+	if (file.Open(filename) != 0)
+		return 1;
+
+	LI row = 0;
+	LI column = 0;
+	lazyinserter h = { *this };
+	csvscan(file.data, file.size, row, column, true, h);
+	return 0;
+}
+
+int csvlazy::SaveFile(const char* filename)
+{
+	return csvsave(*this, filename);
+}
+
+size_t csvlazy::Size()
+{
+	return cells.size();
+}
+
+size_t csvlazy::_lower(LLI index)
+{
+	return lower_bound(cells.begin(), cells.end(), index, [](const slice& c, LLI i) { return c.index < i; }) - cells.begin();
+}
+
+// the text of a cell, decoded into tmp if it needs unescaping
+void csvlazy::_value(const slice& c, const char*& s, size_t& n)
+{
+	const char* b = file.data + c.offset;
+	if (c.isescaped)
+		csvfield(b, b + c.n, tmp, s, n);
+	else
+	{
+		s = b;
+		n = c.n;
+	}
+}
+
+string csvlazy::GetCell(LI row, LI column)
+{
+	string value;
+	Find(row, column, value);
+	return value;
+}
+
+bool csvlazy::GetCellDouble(LI row, LI column, double& x)
+{
+	size_t i = _lower(_index(row, column));
+	if ((i < cells.size()) && (cells[i].index == _index(row, column)))
+	{
+		const char* s;
+		size_t n;
+		_value(cells[i], s, n);
+		return StrDouble(s, n, x);
+	}
+	else
+		return false;
+}
+
+bool csvlazy::Search(const string& value, LI& row, LI& column, bool is_reset)
+{
+	if (is_reset)
+	{
+		row = 0;
+		column = 0;
+	}
+	const char* s;
+	size_t n;
+	for (size_t i = _lower(_index(row, column)); i < cells.size(); i++)
+	{
+		_value(cells[i], s, n);
+		if ((n == value.length()) && (memcmp(s, value.data(), n) == 0))
+		{
+			row = _row(cells[i].index);
+			column = _column(cells[i].index);
+			return true;
+		}
+	}
+	return false;
+}
+
+bool csvlazy::Find(LI row, LI column, string& value)
+{
+	size_t i = _lower(_index(row, column));
+	if ((i < cells.size()) && (cells[i].index == _index(row, column)))
+	{
+		GetIter(i, row, column, value);
+		return true;
+	}
+	else
+	{
+		return false;
+	}
+}
+
+bool csvlazy::LBElem(LI& row, LI& column, string& value)
+{
+	iterator it = _lower(_index(row, column));
+	if (it < cells.size())
+	{
+		GetIter(it, row, column, value);
+		return true;
+	}
+	else
+	{
+		return false;
+	}
+}
+
+bool csvlazy::UBElem(LI& row, LI& column, string& value)
+{
+	iterator it = _lower(_index(row, column));
+	if ((it < cells.size()) && (cells[it].index == _index(row, column)))
+		it++;
+	if (it < cells.size())
+	{
+		GetIter(it, row, column, value);
+		return true;
+	}
+	else
+	{
+		return false;
+	}
+}
+
+bool csvlazy::BeginIter(iterator& it)
+{
+	it = 0;
+	return (it < cells.size());
+}
+
+bool csvlazy::NextIter(iterator& it)
+{
+	it++;
+	return (it < cells.size());
+}
+
+void csvlazy::GetIter(iterator& it, LI& row, LI& column, string& value)
+{
+	const char* s;
+	size_t n;
+	_value(cells[it], s, n);
+	row = _row(cells[it].index);
+	column = _column(cells[it].index);
+	value.assign(s, n);
+}
+
+int csvlazy::Clear()
+{
+	cells.clear();
+	file.Close();
+	return 0;
+}
+
+/****************************************************************************/
+
+LLI csvview::_index(LI row, LI column)
+{
+	return csvindex(row, column);
+}
+LI csvview::_row(LLI index)
+{
+	return csvrow(index);
+}
+LI csvview::_column(LLI index)
+{
+	return csvcolumn(index);
+}
+
+// block b of a table, nullptr if it has no cells
+inline const csvblock* csvtableblock(const csvtable& table, size_t b)
+{
+	size_t p = b / csvpageblocks;
+	if ((p >= table.pages.size()) || !table.pages[p])
+		return nullptr;
+	return table.pages[p]->blocks[b % csvpageblocks].get();
+}
+
+csvview::csvview()
+{
+	table = make_shared< const csvtable >();
+}
+
+int csvview::SaveFile(const char* filename)
+{
+	return csvsave(*this, filename);
+}
+
+// first cell at (or after, with isupper) index
+bool csvview::_seek(LLI index, bool isupper, iterator& it)
+{
+	size_t b = _row(index) / csvblockrows;
+	const csvblock* block = csvtableblock(*table, b);
+	if (block)
+	{
+		it.block = b;
+		it.it = isupper ? block->cells.upper_bound(index) : block->cells.lower_bound(index);
+		if (it.it != block->cells.end())
+			return true;
+	}
+	return _next(b, it);
+}
+
+// first cell of the blocks after block, passing over missing pages
+bool csvview::_next(size_t block, iterator& it)
+{
+	auto& pages = table->pages;
+	for (size_t b = block + 1; b / csvpageblocks < pages.size(); b++)
+	{
+		if (!pages[b / csvpageblocks])
+		{
+			b += csvpageblocks - 1 - b % csvpageblocks;
+			continue;
+		}
+		const csvblock* next = pages[b / csvpageblocks]->blocks[b % csvpageblocks].get();
+		if (next && !next->cells.empty())
+		{
+			it.block = b;
+			it.it = next->cells.begin();
+			return true;
+		}
+	}
+	return false;
+}
+
+string csvview::GetCell(LI row, LI column)
+{
+	string value;
+	Find(row, column, value);
+	return value;
+}
+
+bool csvview::GetCellDouble(LI row, LI column, double& x)
+{
+	string value;
+	if (Find(row, column, value))
+		return StrDouble(value.data(), value.length(), x);
+	else
+		return false;
+}
+
+bool csvview::Search(const string& value, LI& row, LI& column, bool is_reset)
+{
+	if (is_reset)
+	{
+		row = 0;
+		column = 0;
+	}
+	iterator it;
+	for (bool chk = _seek(_index(row, column), false, it); chk; chk = NextIter(it))
+	{
+		if (it.it->second == value)
+		{
+			row = _row(it.it->first);
+			column = _column(it.it->first);
+			return true;
+		}
+	}
+	return false;
+}
+
+bool csvview::Find(LI row, LI column, string& value)
+{
+	const csvblock* block = csvtableblock(*table, row / csvblockrows);
+	if (block)
+	{
+		auto it = block->cells.find(_index(row, column));
+		if (it != block->cells.end())
+		{
+			value = it->second;
+			return true;
+		}
+	}
+	return false;
+}
+
+bool csvview::LBElem(LI& row, LI& column, string& value)
+{
+	iterator it;
+	if (_seek(_index(row, column), false, it))
+	{
+		GetIter(it, row, column, value);
+		return true;
+	}
+	else
+	{
+		return false;
+	}
+}
+
+bool csvview::UBElem(LI& row, LI& column, string& value)
+{
+	iterator it;
+	if (_seek(_index(row, column), true, it))
+	{
+		GetIter(it, row, column, value);
+		return true;
+	}
+	else
+	{
+		return false;
+	}
+}
+
+bool csvview::BeginIter(iterator& it)
+{
+	return _seek(0, false, it);
+}
+
+bool csvview::NextIter(iterator& it)
+{
+	if (++it.it != csvtableblock(*table, it.block)->cells.end())
+		return true;
+	return _next(it.block, it);
+}
+
+void csvview::GetIter(iterator& it, LI& row, LI& column, string& value)
+{
+	row = _row(it.it->first);
+	column = _column(it.it->first);
+	value = it.it->second;
+}
+
+/****************************************************************************/
+
+LLI csvshared::_index(LI row, LI column)
+{
+	return csvindex(row, column);
+}
+
+csvshared::csvshared()
+{
+	current = make_shared< const csvtable >();
+	published = new shared_ptr< const csvtable >(current);
+	reading = 0;
+}
+
+csvshared::~csvshared()
+{
+	delete published.load();
+	for (auto p : retired)
+		delete p;
+}
+
+// Called by writers only. A reader counts itself in reading before it loads
+// published, so when reading is 0 after the exchange no reader can still be
+// copying a retired pointer.
+void csvshared::_publish(shared_ptr< const csvtable > table)
+{
+	current = table;
+	retired.push_back(published.exchange(new shared_ptr< const csvtable >(table)));
+	if (reading.load() == 0)
+	{
+		for (auto p : retired)
+			delete p;
+		retired.clear();
+	}
+}
+
+csvshared::draft::draft(csvshared& shared, const csvtable& from) : csv(shared), table(from)
+{
+
+}
+
+// the cells of the block of row, copied with its page on the first change in
+// this draft
+map< LLI, string >& csvshared::draft::_cells(LI row)
+{
+	size_t b = row / csvblockrows;
+	auto& block = ownblocks[b];
+	if (!block)
+	{
+		size_t p = b / csvpageblocks;
+		auto& page = ownpages[p];
+		if (!page)
+		{
+			if (p >= table.pages.size())
+				table.pages.resize(p + 1);
+			page = table.pages[p] ? make_shared< csvpage >(*table.pages[p]) : make_shared< csvpage >();
+			page->blocks.resize(csvpageblocks);
+			table.pages[p] = page;
+		}
+		auto& from = page->blocks[b % csvpageblocks];
+		block = from ? make_shared< csvblock >(*from) : make_shared< csvblock >();
+		from = block;
+	}
+	return block->cells;
+}
+
+void csvshared::draft::_clear()
+{
+	table.pages.clear();
+	ownpages.clear();
+	ownblocks.clear();
+}
+
+int csvshared::draft::SetCell(LI row, LI column, const string& value)
+{
+	if (value.length() == 0)
+	{
+		EraseCell(row, column);
+		return 1;
+	}
+	_cells(row)[csv._index(row, column)] = value;
+	return 0;
+}
+
+int csvshared::draft::EraseCell(LI row, LI column)
+{
+	const csvblock* block = csvtableblock(table, row / csvblockrows);
+	if (block && (block->cells.count(csv._index(row, column)) > 0))
+		_cells(row).erase(csv._index(row, column));
+	return 0;
+}
+
+string csvshared::draft::GetCell(LI row, LI column)
+{
+	const csvblock* block = csvtableblock(table, row / csvblockrows);
+	if (block)
+	{
+		auto it = block->cells.find(csv._index(row, column));
+		if (it != block->cells.end())
+			return it->second;
+	}
+	return "";
+}
+
+// f(draft&) makes the changes, which are published together when it returns
+template < class F >
+int csvshared::Update(F f)
+{
+	lock_guard< mutex > lk(writing);
+	draft d(*this, *current);
+	f(d);
+	_publish(make_shared< csvtable >(move(d.table)));
+	return 0;
+}
+
+csvview csvshared::View()
+{
+	csvview v;
+	reading++;
+	v.table = *published.load();
+	reading--;
+	return v;
+}
+
+struct csvshared::sharedinserter
+{
+	draft& d;
+	LI block;
+	map< LLI, string >* cells;
+	void cell(LI row, LI column, const char* s, size_t n)
+	{
+		if ((cells == nullptr) || (row / csvblockrows != block))
+		{
+			block = row / csvblockrows;
+			cells = &d._cells(row);
+		}
+		cells->insert_or_assign(cells->end(), d.csv._index(row, column), string(s, n));
+	}
+	bool endrow(size_t)
+	{
+		return true;
+	}
+};
+
+int csvshared::LoadFile(const char* filename)
+{
+	csvmapfile file;
+	if (file.Open(filename) != 0)
+		return 1;
+	return Update([&](draft& d)
+	{
+		d._clear();
+		LI row = 0;
+		LI column = 0;
+		sharedinserter h = { d, 0, nullptr };
+		csvscan(file.data, file.size, row, column, true, h);
+	});
+}
+
+int csvshared::SaveFile(const char* filename)
+{
+	return View().SaveFile(filename);
+}
+
+string csvshared::GetCell(LI row, LI column)
+{
+	return View().GetCell(row, column);
+}
+
+bool csvshared::GetCellDouble(LI row, LI column, double& x)
+{
+	return View().GetCellDouble(row, column, x);
+}
+
+int csvshared::SetCell(LI row, LI column, const string& value)
+{
+	Update([&](draft& d) { d.SetCell(row, column, value); });
+	return (value.length() == 0) ? 1 : 0;
+}
+
+int csvshared::EraseCell(LI row, LI column)
+{
+	return Update([&](draft& d) { d.EraseCell(row, column); });
+}
+
+int csvshared::Clear()
+{
+	return Update([&](draft& d) { d._clear(); });
+}
+
+/****************************************************************************/
+
+csvinput::csvinput()
+{
+	file = nullptr;
+	compress = csvplain;
+	isthread = false;
+	blockpos = 0;
+	isdone = true;
+	isstop = false;
+	isfail = false;
+}
+
+csvinput::~csvinput()
+{
+	Close();
+}
+
+int csvinput::Open(const char* filename, csvcompress format, bool isahead)
+{
+	Close();
+	compress = (format == csvauto) ? csvformat(filename) : format;
+#ifndef CSV_ZLIB
+	if (compress == csvgzip)
+		return 1;
+#endif
+#ifndef CSV_ZSTD
+	if (compress == csvzstd)
+		return 1;
+#endif
+	file = fopen(filename, "rb");
+	if (file == nullptr)
+		return 1;
+	isfail = false;
+	isthread = (compress != csvplain) || isahead;
+	if (isthread)
+	{
+		isdone = false;
+		isstop = false;
+		worker = thread((compress != csvplain) ? &csvinput::_decode : &csvinput::_readahead, this);
+	}
+	return 0;
+}
+
+void csvinput::Close()
+{
+	if (worker.joinable())
+	{
+		{
+			lock_guard< mutex > lk(lock);
+			isstop = true;
+		}
+		change.notify_all();
+		worker.join();
+	}
+	if (file != nullptr)
+		fclose(file);
+	file = nullptr;
+	full.clear();
+	spare.clear();
+	block = vector< char >();
+	blockpos = 0;
+	isdone = true;
+	isthread = false;
+}
+
+bool csvinput::IsFail()
+{
+	lock_guard< mutex > lk(lock);
+	return isfail;
+}
+
+// Returns at most the rest of the current block, 0 at the end of the file.
+size_t csvinput::Read(char* p, size_t n)
+{
+	if (file == nullptr)
+		return 0;
+	if (!isthread)
+	{
+		size_t k = fread(p, 1, n, file);
+		if ((k == 0) && ferror(file))
+			isfail = true;
+		return k;
+	}
+	if (blockpos == block.size())
+	{
+		unique_lock< mutex > lk(lock);
+		spare.push_back(move(block));
+		change.wait(lk, [&] { return !full.empty() || isdone; });
+		if (full.empty())
+		{
+			block.clear();
+			blockpos = 0;
+			return 0;
+		}
+		block = move(full.front());
+		full.pop_front();
+		blockpos = 0;
+		lk.unlock();
+		change.notify_all();
+	}
+	size_t k = (n < block.size() - blockpos) ? n : block.size() - blockpos;
+	memcpy(p, block.data() + blockpos, k);
+	blockpos += k;
+	return k;
+}
+
+// a block for the decoder, reused from the blocks already read when possible
+vector< char > csvinput::_take()
+{
+	const size_t blocksize = 1 << 20;
+	vector< char > b;
+	{
+		lock_guard< mutex > lk(lock);
+		if (!spare.empty())
+		{
+			b = move(spare.back());
+			spare.pop_back();
+		}
+	}
+	b.resize(blocksize);
+	return b;
+}
+
+// hands the first n bytes of b to Read(), waits while enough blocks are ahead
+bool csvinput::_push(vector< char >& b, size_t n)
+{
+	const size_t ahead = 4;
+	b.resize(n);
+	unique_lock< mutex > lk(lock);
+	change.wait(lk, [&] { return (full.size() < ahead) || isstop; });
+	if (isstop)
+		return false;
+	full.push_back(move(b));
+	lk.unlock();
+	change.notify_all();
+	return true;
+}
+
+void csvinput::_decode()
+{
+	vector< char > in(1 << 18);
+	vector< char > out = _take();
+	size_t outlen = 0;
+	bool isgood = true;
+	bool isrun = true;
+#ifdef CSV_ZLIB
+	if (compress == csvgzip)
+	{
+		// 15 + 32: zlib or gzip header, files of several gzip members are read through
+		z_stream zs;
+		memset(&zs, 0, sizeof(zs));
+		isgood = (inflateInit2(&zs, 15 + 32) == Z_OK);
+		int ret = Z_OK;
+		while (isgood && isrun)
+		{
+			if (zs.avail_in == 0)
+			{
+				size_t k = fread(in.data(), 1, in.size(), file);
+				if (k == 0)
+				{
+					isgood = (ret == Z_STREAM_END) && !ferror(file);
+					break;
+				}
+				zs.next_in = (Bytef*)in.data();
+				zs.avail_in = (uInt)k;
+			}
+			if (ret == Z_STREAM_END)
+				inflateReset(&zs);
+			zs.next_out = (Bytef*)out.data() + outlen;
+			zs.avail_out = (uInt)(out.size() - outlen);
+			ret = inflate(&zs, Z_NO_FLUSH);
+			if ((ret != Z_OK) && (ret != Z_STREAM_END))
+				isgood = false;
+			outlen = out.size() - zs.avail_out;
+			if (outlen == out.size())
+			{
+				isrun = _push(out, outlen);
+				out = _take();
+				outlen = 0;
+			}
+		}
+		inflateEnd(&zs);
+	}
+#endif
+#ifdef CSV_ZSTD
+	if (compress == csvzstd)
+	{
+		ZSTD_DCtx* zd = ZSTD_createDCtx();
+		isgood = (zd != nullptr);
+		size_t ret = 0;
+		ZSTD_inBuffer zin = { in.data(), 0, 0 };
+		while (isgood && isrun)
+		{
+			if (zin.pos == zin.size)
+			{
+				size_t k = fread(in.data(), 1, in.size(), file);
+				if (k == 0)
+				{
+					isgood = (ret == 0) && !ferror(file);
+					break;
+				}
+				zin.size = k;
+				zin.pos = 0;
+			}
+			ZSTD_outBuffer zout = { out.data(), out.size(), outlen };
+			ret = ZSTD_decompressStream(zd, &zout, &zin);
+			if (ZSTD_isError(ret))
+				isgood = false;
+			outlen = zout.pos;
+			if (outlen == out.size())
+			{
+				isrun = _push(out, outlen);
+				out = _take();
+				outlen = 0;
+			}
+		}
+		ZSTD_freeDCtx(zd);
+	}
+#endif
+	if (isrun && (outlen > 0))
+		_push(out, outlen);
+	{
+		lock_guard< mutex > lk(lock);
+		isdone = true;
+		isfail = !isgood;
+	}
+	change.notify_all();
+}
+
+#if defined(CSV_URING) && defined(__linux__)
+// The few io_uring calls the reader needs, made directly without liburing.
+struct csvuring
+{
+	int fd = -1;
+	void* sqmap = MAP_FAILED;
+	void* cqmap = MAP_FAILED;
+	void* sqemap = MAP_FAILED;
+	size_t sqsize = 0;
+	size_t cqsize = 0;
+	size_t sqesize = 0;
+	unsigned* sqtail;
+	unsigned* sqmask;
+	unsigned* sqarray;
+	unsigned* cqhead;
+	unsigned* cqtail;
+	unsigned* cqmask;
+	io_uring_sqe* sqes;
+	io_uring_cqe* cqes;
+	unsigned queued = 0;
+	int Open(unsigned entries)
+	{
+		io_uring_params p;
+		memset(&p, 0, sizeof(p));
+		fd = (int)syscall(__NR_io_uring_setup, entries, &p);
+		if (fd < 0)
+			return 1;
+		sqsize = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+		cqsize = p.cq_off.cqes + p.cq_entries * sizeof(io_uring_cqe);
+		bool issingle = (p.features & IORING_FEAT_SINGLE_MMAP) != 0;
+		if (issingle)
+			sqsize = cqsize = (sqsize > cqsize) ? sqsize : cqsize;
+		sqmap = mmap(NULL, sqsize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+		if (sqmap == MAP_FAILED)
+		{
+			Close();
+			return 1;
+		}
+		cqmap = issingle ? sqmap : mmap(NULL, cqsize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+		sqesize = p.sq_entries * sizeof(io_uring_sqe);
+		sqemap = mmap(NULL, sqesize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+		if ((cqmap == MAP_FAILED) || (sqemap == MAP_FAILED))
+		{
+			Close();
+			return 1;
+		}
+		char* s = (char*)sqmap;
+		sqtail = (unsigned*)(s + p.sq_off.tail);
+		sqmask = (unsigned*)(s + p.sq_off.ring_mask);
+		sqarray = (unsigned*)(s + p.sq_off.array);
+		char* c = (char*)cqmap;
+		cqhead = (unsigned*)(c + p.cq_off.head);
+		cqtail = (unsigned*)(c + p.cq_off.tail);
+		cqmask = (unsigned*)(c + p.cq_off.ring_mask);
+		cqes = (io_uring_cqe*)(c + p.cq_off.cqes);
+		sqes = (io_uring_sqe*)sqemap;
+		return 0;
+	}
+	// queues a read of one iovec, submitted by the next Submit()
+	void Read(int file, const iovec* v, uint64_t offset, uint64_t tag)
+	{
+		unsigned tail = *sqtail;
+		unsigned i = tail & *sqmask;
+		io_uring_sqe& e = sqes[i];
+		memset(&e, 0, sizeof(e));
+		e.opcode = IORING_OP_READV;
+		e.fd = file;
+		e.addr = (uint64_t)(uintptr_t)v;
+		e.len = 1;
+		e.off = offset;
+		e.user_data = tag;
+		sqarray[i] = i;
+		__atomic_store_n(sqtail, tail + 1, __ATOMIC_RELEASE);
+		queued++;
+	}
+	// submits the queued reads and waits for at least wait completions
+	bool Submit(unsigned wait)
+	{
+		for (;;)
+		{
+			long k = syscall(__NR_io_uring_enter, fd, queued, wait, wait ? IORING_ENTER_GETEVENTS : 0, NULL, 0);
+			if (k >= 0)
+			{
+				queued -= (unsigned)k;
+				return true;
+			}
+			if (errno != EINTR)
+				return false;
+		}
+	}
+	bool Reap(uint64_t& tag, int& res)
+	{
+		unsigned head = *cqhead;
+		if (head == __atomic_load_n(cqtail, __ATOMIC_ACQUIRE))
+			return false;
+		io_uring_cqe& e = cqes[head & *cqmask];
+		tag = e.user_data;
+		res = e.res;
+		__atomic_store_n(cqhead, head + 1, __ATOMIC_RELEASE);
+		return true;
+	}
+	void Close()
+	{
+		if (sqemap != MAP_FAILED)
+			munmap(sqemap, sqesize);
+		if ((cqmap != MAP_FAILED) && (cqmap != sqmap))
+			munmap(cqmap, cqsize);
+		if (sqmap != MAP_FAILED)
+			munmap(sqmap, sqsize);
+		if (fd >= 0)
+			close(fd);
+		fd = -1;
+		sqmap = cqmap = sqemap = MAP_FAILED;
+	}
+};
+#endif
+
+// Reads a plain file ahead of Read(). With io_uring several block reads are in
+// flight at once and handed over in file order as they complete, otherwise
+// the blocks are read one after another with pread.
+void csvinput::_readahead()
+{
+	const size_t blocksize = 1 << 20;
+	bool isgood = true;
+	bool isrun = true;
+#ifdef _WIN32
+	while (isrun)
+	{
+		vector< char > out = _take();
+		size_t k = fread(out.data(), 1, blocksize, file);
+		if (k == 0)
+		{
+			isgood = !ferror(file);
+			break;
+		}
+		isrun = _push(out, k);
+	}
+#else
+	int fd = fileno(file);
+	bool isring = false;
+#if defined(CSV_URING) && defined(__linux__)
+	const unsigned depth = 4;
+	struct stat st;
+	csvuring ring;
+	if ((fstat(fd, &st) == 0) && S_ISREG(st.st_mode) && (ring.Open(depth) == 0))
+	{
+		struct request
+		{
+			vector< char > b;
+			iovec v;
+			size_t offset;
+			size_t want;
+			size_t got;
+			bool isbusy;
+			bool isready;
+		};
+		vector< request > reqs(depth);
+		size_t size = (size_t)st.st_size;
+		size_t next = 0;
+		size_t deliver = 0;
+		unsigned inflight = 0;
+		auto issue = [&](unsigned k)
+		{
+			request& q = reqs[k];
+			q.b = _take();
+			q.offset = next;
+			q.want = (size - next < blocksize) ? size - next : blocksize;
+			q.got = 0;
+			q.isbusy = true;
+			q.isready = false;
+			q.v.iov_base = q.b.data();
+			q.v.iov_len = q.want;
+			next += q.want;
+			ring.Read(fd, &q.v, q.offset, k);
+			inflight++;
+		};
+		for (unsigned k = 0; k < depth; k++)
+		{
+			reqs[k].isbusy = false;
+			if (next < size)
+				issue(k);
+		}
+		isring = true;
+		while (isgood && isrun && (deliver < size))
+		{
+			// every read below size came back, so the file got shorter
+			if (inflight == 0)
+				break;
+			if (!ring.Submit(1))
+			{
+				isgood = false;
+				break;
+			}
+			uint64_t tag;
+			int res;
+			while (ring.Reap(tag, res))
+			{
+				request& q = reqs[tag];
+				inflight--;
+				if ((res < 0) && (res != -EINTR) && (res != -EAGAIN))
+				{
+					isgood = false;
+					continue;
+				}
+				if (res == 0)
+				{
+					// the file got shorter; completions come in any order, so
+					// a later one for a higher offset must not raise size again
+					size = min(size, q.offset + q.got);
+					q.isready = true;
+					continue;
+				}
+				if (res > 0)
+					q.got += res;
+				if ((q.got == q.want) || (q.offset + q.got >= size))
+				{
+					q.isready = true;
+					continue;
+				}
+				q.v.iov_base = q.b.data() + q.got;
+				q.v.iov_len = q.want - q.got;
+				ring.Read(fd, &q.v, q.offset + q.got, tag);
+				inflight++;
+			}
+			for (bool ismore = true; ismore && isrun && (deliver < size); )
+			{
+				ismore = false;
+				for (unsigned k = 0; k < depth; k++)
+				{
+					request& q = reqs[k];
+					if (q.isbusy && q.isready && (q.offset == deliver))
+					{
+						// Read() takes an empty block for the end of the file
+						size_t got = min(q.got, size - q.offset);
+						deliver += got;
+						q.isbusy = false;
+						if (got > 0)
+							isrun = _push(q.b, got);
+						if (isrun && (next < size))
+							issue(k);
+						ismore = true;
+					}
+				}
+			}
+		}
+		// the kernel may still write into the buffers of reads in flight
+		while ((inflight > 0) && ring.Submit(1))
+		{
+			uint64_t tag;
+			int res;
+			while (ring.Reap(tag, res))
+				inflight--;
+		}
+		ring.Close();
+	}
+#endif
+	for (LLI at = 0; !isring && isrun; )
+	{
+		vector< char > out = _take();
+		ssize_t k = pread(fd, out.data(), blocksize, (off_t)at);
+		if ((k < 0) && (errno == EINTR))
+			continue;
+		if (k <= 0)
+		{
+			isgood = (k == 0);
+			break;
+		}
+		at += k;
+		isrun = _push(out, (size_t)k);
+	}
+#endif
+	{
+		lock_guard< mutex > lk(lock);
+		isdone = true;
+		isfail = !isgood;
+	}
+	change.notify_all();
+}
+
+/****************************************************************************/
+
+csvreader::csvreader()
+{
+	pos = 0;
+	len = 0;
+	iseof = true;
+	row = 0;
+}
+
+csvreader::~csvreader()
+{
+	Close();
+}
+
+int csvreader::Open(const char* filename, size_t bufsize, csvcompress format, bool isahead)
+{
+	Close();
+	if (input.Open(filename, format, isahead) != 0)
+		return 1;
+	buf.resize((bufsize > 0) ? bufsize : 1);
+	iseof = false;
+	return 0;
+}
+
+bool csvreader::IsFail()
+{
+	return input.IsFail();
+}
+
+void csvreader::Close()
+{
+	input.Close();
+	pos = 0;
+	len = 0;
+	iseof = true;
+	row = 0;
+}
+
+// moves the unscanned bytes to the front and reads more
+bool csvreader::_fill()
+{
+	if (iseof)
+		return false;
+	memmove(buf.data(), buf.data() + pos, len - pos);
+	len -= pos;
+	pos = 0;
+	if (len == buf.size())
+		buf.resize(buf.size() * 2);
+	size_t n = input.Read(buf.data() + len, buf.size() - len);
+	len += n;
+	if (n == 0)
+		iseof = true;
+	return true;
+}
+
+// collects the cells of one row, stops the scan at its end
+struct csvreader::rowcollector
+{
+	csvreader& rd;
+	bool isrow;
+	void cell(LI, LI column, const char* s, size_t n)
+	{
+		if (column >= rd.cells.size())
+			rd.cells.resize((size_t)column + 1, field{ 0, 0, false });
+		field& f = rd.cells[column];
+		f.n = n;
+		f.isscratch = ((s < rd.buf.data()) || (s >= rd.buf.data() + rd.len));
+		if (f.isscratch)
+		{
+			f.offset = rd.scratch.length();
+			rd.scratch.append(s, n);
+		}
+		else
+			f.offset = s - rd.buf.data();
+	}
+	bool endrow(size_t)
+	{
+		isrow = true;
+		return false;
+	}
+};
+
+bool csvreader::NextRow(LI& r, vector< string_view >& fields)
+{
+	for (;;)
+	{
+		LI nextrow = row;
+		LI column = 0;
+		cells.clear();
+		scratch.clear();
+		rowcollector h = { *this, false };
+		size_t used = csvscan(buf.data() + pos, len - pos, nextrow, column, iseof, h);
+		if (h.isrow || (iseof && !cells.empty()))
+		{
+			pos += used;
+			r = row;
+			row = nextrow;
+			fields.resize(cells.size());
+			for (size_t k = 0; k < cells.size(); k++)
+				fields[k] = string_view((cells[k].isscratch ? scratch.data() : buf.data()) + cells[k].offset, cells[k].n);
+			return true;
+		}
+		if (iseof)
+		{
+			pos = len;
+			return false;
+		}
+		// the row is not complete in the buffer
+		_fill();
+	}
+}
+
+template < class F >
+int csvreader::ForEachRow(F f)
+{
+	LI r;
+	vector< string_view > fields;
+	while (NextRow(r, fields))
+		if (!f(r, fields))
+			break;
+	return 0;
+}
+
+// one pass over the remaining rows, skipping rows of only empty fields
+int csvreader::GroupBy(const vector< LI >& keys, const vector< LI >& columns, vector< csvgroup >& groups)
+{
+	csvaggregate a(keys, columns);
+	ForEachRow([&](LI r, vector< string_view >& fields)
+	{
+		bool isempty = true;
+		for (LI column = 0; column < fields.size(); column++)
+		{
+			if (fields[column].empty())
+				continue;
+			a.Cell(column, fields[column]);
+			isempty = false;
+		}
+		if (!isempty)
+			a.Row(r);
+		return true;
+	});
+	a.Finish(groups);
+	return IsFail() ? 1 : 0;
+}
+
+/****************************************************************************/
+
+LLI csvcells::_index(LI row, LI column)
+{
+	return csvindex(row, column);
+}
+LI csvcells::_row(LLI index)
+{
+	return csvrow(index);
+}
+LI csvcells::_column(LLI index)
+{
+	return csvcolumn(index);
+}
+
+csvcells::csvcells()
+{
+
+}
+
+csvcells::~csvcells()
+{
+	Clear();
+}
+
+void csvcells::_set(LI row, LI column, const char* s, size_t n)
+{
+	if (n == 0)
+	{
+		csv_map.erase(_index(row, column));
+		return;
+	}
+	csvtext t;
+	t.s = ((column < intern.size()) && intern[column]) ? arena.Intern(s, n) : arena.Add(s, n);
+	t.n = n;
+	csv_map.insert_or_assign(csv_map.end(), _index(row, column), t);
+}
+
+// stores the scanned cells in the arena
+struct csvcells::cellinserter
+{
+	csvcells& csv;
+	void cell(LI row, LI column, const char* s, size_t n)
+	{
+		csv._set(row, column, s, n);
+	}
+	bool endrow(size_t)
+	{
+		return true;
+	}
+};
+
+void csvcells::SetIntern(LI column, bool isintern)
+{
+	if (column >= intern.size())
+		intern.resize((size_t)column + 1);
+	intern[column] = isintern;
+}
+
+int csvcells::LoadFile(const char* filename, bool isclear)
+{
+	if (isclear)
+		Clear();
+
+	csvmapfile file;
+	if (file.Open(filename) != 0)
+		return 1;
+
+	LI row = 0;
+	LI column = 0;
+	cellinserter h = { *this };
+	csvscan(file.data, file.size, row, column, true, h);
+	return 0;
+}
+
+int csvcells::SaveFile(const char* filename)
+{
+	return csvsave(*this, filename);
+}
+
+int csvcells::EraseCell(LI row, LI column)
+{
+	csv_map.erase(_index(row, column));
+	return 0;
+}
+
+int csvcells::SetCell(LI row, LI column, const string& value)
+{
+	_set(row, column, value.data(), value.length());
+	return (value.length() == 0) ? 1 : 0;
+}
+
+string csvcells::GetCell(LI row, LI column)
+{
+	auto it = csv_map.find(_index(row, column));
+	if (it != csv_map.end())
+		return string(it->second.s, it->second.n);
+	else
+		return "";
+}
+
+bool csvcells::GetCellDouble(LI row, LI column, double& x)
+{
+	auto it = csv_map.find(_index(row, column));
+	if (it != csv_map.end())
+		return StrDouble(it->second.s, it->second.n, x);
+	else
+		return false;
+}
+
+bool csvcells::Search(const string& value, LI& row, LI& column, bool is_reset)
+{
+	if (is_reset)
+	{
+		row = 0;
+		column = 0;
+	}
+	for (iterator it = csv_map.lower_bound(_index(row, column)); it != csv_map.end(); ++it)
+	{
+		if ((it->second.n == value.length()) && (memcmp(it->second.s, value.data(), value.length()) == 0))
+		{
+			LLI ind = it->first;
+			row = _row(ind);
+			column = _column(ind);
+			return true;
+		}
+	}
+	return false;
+}
+
+bool csvcells::Find(LI row, LI column, string& value)
+{
+	iterator it = csv_map.find(_index(row, column));
+	if (it != csv_map.end())
+	{
+		value.assign(it->second.s, it->second.n);
+		return true;
+	}
+	else
+	{
+		return false;
+	}
+}
+
+bool csvcells::LBElem(LI& row, LI& column, string& value)
+{
+	iterator it = csv_map.lower_bound(_index(row, column));
+	if (it != csv_map.end())
+	{
+		GetIter(it, row, column, value);
+		return true;
+	}
+	else
+	{
+		return false;
+	}
+}
+
+bool csvcells::UBElem(LI& row, LI& column, string& value)
+{
+	iterator it = csv_map.upper_bound(_index(row, column));
+	if (it != csv_map.end())
+	{
+		GetIter(it, row, column, value);
+		return true;
+	}
+	else
+	{
+		return false;
+	}
+}
+
+bool csvcells::BeginIter(iterator& it)
+{
+	it = csv_map.begin();
+	return (it != csv_map.end());
+}
+
+bool csvcells::NextIter(iterator& it)
+{
+	it++;
+	return (it != csv_map.end());
+}
+
+void csvcells::GetIter(iterator& it, LI& row, LI& column, string& value)
+{
+	row = _row(it->first);
+	column = _column(it->first);
+	value.assign(it->second.s, it->second.n);
+}
+
+int csvcells::Clear()
+{
+	csv_map.clear();
+	arena.Clear();
+	return 0;
+}
+
+/****************************************************************************/
+
+LLI csvhash::_index(LI row, LI column)
+{
+	return csvindex(row, column);
+}
+LI csvhash::_row(LLI index)
+{
+	return csvrow(index);
+}
+LI csvhash::_column(LLI index)
+{
+	return csvcolumn(index);
+}
+
+csvhash::csvhash()
+{
+	count = 0;
+	isordered = true;
+}
+
+csvhash::~csvhash()
+{
+	Clear();
+}
+
+// Linear probing in a power of two table kept at most 3/4 full. Erasing moves
+// the following cells of the probe run back, so there are no deleted markers.
+size_t csvhash::_home(LLI index)
+{
+	return (size_t)((index * 0x9E3779B97F4A7C15ULL) >> 32) & (slots.size() - 1);
+}
+
+csvhash::slot* csvhash::_find(LLI index)
+{
+	if (count == 0)
+		return nullptr;
+	for (size_t i = _home(index); slots[i].isused; i = (i + 1) & (slots.size() - 1))
+		if (slots[i].index == index)
+			return &slots[i];
+	return nullptr;
+}
+
+string& csvhash::_insert(LLI index)
+{
+	if (4 * (count + 1) > 3 * slots.size())
+		_grow(slots.empty() ? 64 : 2 * slots.size());
+	size_t i = _home(index);
+	for (; slots[i].isused; i = (i + 1) & (slots.size() - 1))
+		if (slots[i].index == index)
+			return slots[i].value;
+	slots[i].index = index;
+	slots[i].isused = true;
+	count++;
+	isordered = false;
+	return slots[i].value;
+}
+
+void csvhash::_erase(LLI index)
+{
+	slot* at = _find(index);
+	if (!at)
+		return;
+	size_t mask = slots.size() - 1;
+	size_t hole = at - slots.data();
+	for (size_t i = (hole + 1) & mask; slots[i].isused; i = (i + 1) & mask)
+	{
+		// a cell can fill the hole if the hole is on its probe run
+		size_t home = _home(slots[i].index);
+		if (((i - home) & mask) >= ((i - hole) & mask))
+		{
+			slots[hole].index = slots[i].index;
+			slots[hole].value.swap(slots[i].value);
+			hole = i;
+		}
+	}
+	slots[hole].isused = false;
+	slots[hole].value.clear();
+	count--;
+	isordered = false;
+}
+
+void csvhash::_grow(size_t size)
+{
+	vector< slot > old(size);
+	old.swap(slots);
+	for (auto& it : old)
+	{
+		if (!it.isused)
+			continue;
+		size_t i = _home(it.index);
+		while (slots[i].isused)
+			i = (i + 1) & (slots.size() - 1);
+		slots[i].index = it.index;
+		slots[i].value.swap(it.value);
+		slots[i].isused = true;
+	}
+}
+
+// sorts the cell indexes for the ordered view
+void csvhash::_order()
+{
+	if (isordered)
+		return;
+	order.clear();
+	order.reserve(count);
+	for (auto& it : slots)
+		if (it.isused)
+			order.push_back(it.index);
+	sort(order.begin(), order.end());
+	isordered = true;
+}
+
+struct csvhash::hashinserter
+{
+	csvhash& csv;
+	void cell(LI row, LI column, const char* s, size_t n)
+	{
+		csv._insert(csv._index(row, column)).assign(s, n);
+	}
+	bool endrow(size_t)
+	{
+		return true;
+	}
+};
+
+void csvhash::Reserve(size_t cells)
+{
+	size_t size = slots.empty() ? 64 : slots.size();
+	while (4 * cells > 3 * size)
+		size *= 2;
+	if (size > slots.size())
+		_grow(size);
+}
+
+int csvhash::LoadFile(const char* filename, bool isclear)
+{
+	if (isclear)
+		Clear();
+
+	csvmapfile file;
+	if (file.Open(filename) != 0)
+		return 1;
+
+	LI row = 0;
+	LI column = 0;
+	hashinserter h = { *this };
+	csvscan(file.data, file.size, row, column, true, h);
+	return 0;
+}
+
+int csvhash::SaveFile(const char* filename)
+{
+	return csvsave(*this, filename);
+}
+
+int csvhash::EraseCell(LI row, LI column)
+{
+	_erase(_index(row, column));
+	return 0;
+}
+
+int csvhash::SetCell(LI row, LI column, const string& value)
+{
+	if (value.length() == 0)
+	{
+		_erase(_index(row, column));
+		return 1;
+	}
+	_insert(_index(row, column)) = value;
+	return 0;
+}
+
+string csvhash::GetCell(LI row, LI column)
+{
+	slot* at = _find(_index(row, column));
+	if (at)
+		return at->value;
+	else
+		return "";
+}
+
+bool csvhash::GetCellDouble(LI row, LI column, double& x)
+{
+	slot* at = _find(_index(row, column));
+	if (at)
+		return StrDouble(at->value.data(), at->value.length(), x);
+	else
+		return false;
+}
+
+bool csvhash::Search(const string& value, LI& row, LI& column, bool is_reset)
+{
+	if (is_reset)
+	{
+		row = 0;
+		column = 0;
+	}
+	_order();
+	for (auto it = lower_bound(order.begin(), order.end(), _index(row, column)); it != order.end(); ++it)
+	{
+		if (_find(*it)->value == value)
+		{
+			row = _row(*it);
+			column = _column(*it);
+			return true;
+		}
+	}
+	return false;
 }
 
-int csvdata::SaveFile(const char* filename)
+bool csvhash::Find(LI row, LI column, string& value)
 {
-	LI row = 0;
-	LI column = 0;
-
-	ofstream os(filename);
+	slot* at = _find(_index(row, column));
+	if (at)
+	{
+		value = at->value;
+		return true;
+	}
+	else
+	{
+		return false;
+	}
+}
 
-	if (!os.good())
+bool csvhash::LBElem(LI& row, LI& column, string& value)
+{
+	_order();
+	iterator it = lower_bound(order.begin(), order.end(), _index(row, column)) - order.begin();
+	if (it != order.size())
 	{
-		return 1;
+		GetIter(it, row, column, value);
+		return true;
+	}
+	else
+	{
+		return false;
 	}
+}
 
-	for (auto it : csv_map)
+bool csvhash::UBElem(LI& row, LI& column, string& value)
+{
+	_order();
+	iterator it = upper_bound(order.begin(), order.end(), _index(row, column)) - order.begin();
+	if (it != order.size())
 	{
-		LLI ind = it.first;
-		if (row < _row(ind))
-		{
-			while (row<_row(ind))
-			{
-				os << "\n";
-				row++;
-			}
-			column = 0;
-		}
-		while (column < _column(ind))
-		{
-			os << ",";
-			column++;
-		}
-		os << SafeStr(it.second).c_str();
+		GetIter(it, row, column, value);
+		return true;
+	}
+	else
+	{
+		return false;
 	}
+}
 
-	os << "\n";
-	os.close();
-	return 0;
+// Adding or erasing cells while iterating ends the ordered view in use.
+bool csvhash::BeginIter(iterator& it)
+{
+	_order();
+	it = 0;
+	return (it != order.size());
 }
 
-int csvdata::EraseCell(LI row, LI column)
+bool csvhash::NextIter(iterator& it)
 {
-	csv_map.erase(_index(row, column));
+	it++;
+	return (it < order.size());
+}
+
+void csvhash::GetIter(iterator& it, LI& row, LI& column, string& value)
+{
+	row = _row(order[it]);
+	column = _column(order[it]);
+	value = _find(order[it])->value;
+}
+
+int csvhash::Clear()
+{
+	slots.clear();
+	order.clear();
+	count = 0;
+	isordered = true;
 	return 0;
 }
 
-int csvdata::SetCell(LI row, LI column, const string& value)
+// The reference is valid until a cell is added or erased.
+string& csvhash::operator() (const LI row, const LI column)
 {
-	unsigned int len = (unsigned)value.length();
-	if (len == 0)
+	return _insert(_index(row, column));
+}
+
+/****************************************************************************/
+
+csvsnapshot::csvsnapshot()
+{
+	rows = nullptr;
+	columns = nullptr;
+	offsets = nullptr;
+	heap = nullptr;
+	count = 0;
+}
+
+csvsnapshot::~csvsnapshot()
+{
+	Close();
+}
+
+// The header and the sizes are always checked. With ischeck the checksum, the
+// offsets and the order of the cells are checked too, which reads the file once.
+int csvsnapshot::Open(const char* filename, bool ischeck)
+{
+	Close();
+	if (file.Open(filename) != 0)
+		return 1;
+	csvsnapheader head;
+	if (file.size < sizeof(head))
 	{
-		csv_map.erase(_index(row, column));
+		Close();
 		return 1;
 	}
-	else
+	memcpy(&head, file.data, sizeof(head));
+	size_t body = file.size - sizeof(head);
+	if ((memcmp(head.magic, "CSVSNAP", 8) != 0) || (head.version != 1) || (head.order != 0x01020304)
+		|| (head.count > body / 16) || (body - 16 * head.count < 8) || (head.heapsize != body - 16 * head.count - 8))
 	{
-		csv_map[_index(row, column)] = value;
-		return 0;
+		Close();
+		return 1;
+	}
+	const char* p = file.data + sizeof(head);
+	rows = (const uint32_t*)p;
+	columns = (const uint32_t*)(p + 4 * head.count);
+	offsets = (const uint64_t*)(p + 8 * head.count);
+	heap = p + 16 * head.count + 8;
+	count = (size_t)head.count;
+	if (offsets[0] != 0 || offsets[count] != head.heapsize)
+	{
+		Close();
+		return 1;
+	}
+	if (ischeck)
+	{
+		csvchecksum sum;
+		sum.Add(p, body);
+		bool isgood = (sum.Value() == head.checksum);
+		for (size_t i = 1; isgood && (i < count); i++)
+			isgood = (offsets[i] <= offsets[i + 1])
+				&& ((rows[i - 1] < rows[i]) || ((rows[i - 1] == rows[i]) && (columns[i - 1] < columns[i])));
+		if (!isgood)
+		{
+			Close();
+			return 1;
+		}
 	}
+	return 0;
 }
 
-string csvdata::GetCell(LI row, LI column)
+void csvsnapshot::Close()
 {
-	auto it = csv_map.find(_index(row, column));
-	if (it != csv_map.end())
-		return it->second;
-	else
-		return "";
+	file.Close();
+	rows = nullptr;
+	columns = nullptr;
+	offsets = nullptr;
+	heap = nullptr;
+	count = 0;
 }
 
-bool csvdata::GetCellDouble(LI row, LI column, double& x)
+size_t csvsnapshot::Size()
 {
-	auto it = csv_map.find(_index(row, column));
-	if (it != csv_map.end())
+	return count;
+}
+
+// first cell at or after row, column
+size_t csvsnapshot::_lower(LI row, LI column)
+{
+	size_t lo = 0;
+	size_t hi = count;
+	while (lo < hi)
 	{
-		return StrDouble(it->second, x);
+		size_t mid = lo + (hi - lo) / 2;
+		if ((rows[mid] < row) || ((rows[mid] == row) && (columns[mid] < column)))
+			lo = mid + 1;
+		else
+			hi = mid;
 	}
+	return lo;
+}
+
+string csvsnapshot::GetCell(LI row, LI column)
+{
+	string value;
+	Find(row, column, value);
+	return value;
+}
+
+bool csvsnapshot::GetCellDouble(LI row, LI column, double& x)
+{
+	size_t i = _lower(row, column);
+	if ((i < count) && (rows[i] == row) && (columns[i] == column))
+		return StrDouble(heap + offsets[i], (size_t)(offsets[i + 1] - offsets[i]), x);
 	else
 		return false;
 }
 
-bool csvdata::Search(const string& value, LI& row, LI& column, bool is_reset)
+bool csvsnapshot::Search(const string& value, LI& row, LI& column, bool is_reset)
 {
 	if (is_reset)
 	{
 		row = 0;
 		column = 0;
 	}
-	for (map< LLI, string >::iterator it = csv_map.lower_bound(_index(row, column)); it != csv_map.end(); ++it)
+	for (size_t i = _lower(row, column); i < count; i++)
 	{
-		if (strcmp(it->second.c_str(), value.c_str()) == 0)
+		if ((offsets[i + 1] - offsets[i] == value.length()) && (memcmp(heap + offsets[i], value.data(), value.length()) == 0))
 		{
-			LLI ind = it->first;
-			row = _row(ind);
-			column = _column(ind);
+			row = rows[i];
+			column = columns[i];
 			return true;
 		}
 	}
 	return false;
 }
 
-bool csvdata::Find(LI row, LI column, string& value)
+bool csvsnapshot::Find(LI row, LI column, string& value)
 {
-	map< LLI, string >::iterator it = csv_map.find(_index(row, column));
-	if (it != csv_map.end())
+	size_t i = _lower(row, column);
+	if ((i < count) && (rows[i] == row) && (columns[i] == column))
 	{
-		value = it->second;
+		value.assign(heap + offsets[i], (size_t)(offsets[i + 1] - offsets[i]));
 		return true;
 	}
 	else
@@ -340,15 +6177,12 @@ bool csvdata::Find(LI row, LI column, string& value)
 	}
 }
 
-bool csvdata::LBElem(LI& row, LI& column, string& value)
+bool csvsnapshot::LBElem(LI& row, LI& column, string& value)
 {
-	map< LLI, string >::iterator it = csv_map.lower_bound(_index(row, column));
-	if (it != csv_map.end())
+	iterator it = _lower(row, column);
+	if (it < count)
 	{
-		LLI ind = it->first;
-		row = _row(ind);
-		column = _column(ind);
-		value = it->second;
+		GetIter(it, row, column, value);
 		return true;
 	}
 	else
@@ -357,15 +6191,14 @@ bool csvdata::LBElem(LI& row, LI& column, string& value)
 	}
 }
 
-bool csvdata::UBElem(LI& row, LI& column, string& value)
+bool csvsnapshot::UBElem(LI& row, LI& column, string& value)
 {
-	map< LLI, string >::iterator it = csv_map.upper_bound(_index(row, column));
-	if (it != csv_map.end())
+	iterator it = _lower(row, column);
+	if ((it < count) && (rows[it] == row) && (columns[it] == column))
+		it++;
+	if (it < count)
 	{
-		LLI ind = it->first;
-		row = _row(ind);
-		column = _column(ind);
-		value = it->second;
+		GetIter(it, row, column, value);
 		return true;
 	}
 	else
@@ -374,34 +6207,30 @@ bool csvdata::UBElem(LI& row, LI& column, string& value)
 	}
 }
 
-bool csvdata::BeginIter(map< LLI, string >::iterator& it)
+bool csvsnapshot::BeginIter(iterator& it)
 {
-	it = csv_map.begin();
-	return (it != csv_map.end());
+	it = 0;
+	return (it < count);
 }
 
-bool csvdata::NextIter(map< LLI, string >::iterator& it)
+bool csvsnapshot::NextIter(iterator& it)
 {
 	it++;
-	return (it != csv_map.end());
+	return (it < count);
 }
 
-void csvdata::GetIter(map< LLI, string >::iterator& it, LI& row, LI& column, string& value)
-{
-	row = _row(it->first);
-	column = _column(it->first);
-	value = it->second;
-}
-
-int csvdata::Clear()
+void csvsnapshot::GetIter(iterator& it, LI& row, LI& column, string& value)
 {
-	csv_map.clear();
-	return 0;
+	row = rows[it];
+	column = columns[it];
+	value.assign(heap + offsets[it], (size_t)(offsets[it + 1] - offsets[it]));
 }
 
-string& csvdata::operator() (const LI row, const LI column)
+void csvsnapshot::GetIterView(iterator& it, LI& row, LI& column, string_view& value)
 {
-	return csv_map[_index(row, column)];
+	row = rows[it];
+	column = columns[it];
+	value = string_view(heap + offsets[it], (size_t)(offsets[it + 1] - offsets[it]));
 }
 
 /****************************************************************************/
@@ -487,6 +6316,68 @@ bool StrDouble(const string s, double& x)
 	return true;
 }
 
+// Same result as above without a copy or exceptions for plain decimal numbers.
+// Leading '+', hexadecimal, inf, nan, out of range and subnormal values go to
+// stod, which may reject subnormals as out of range where from_chars does not.
+bool StrDouble(const char* s, size_t n, double& x)
+{
+	const char* end = s + n;
+	const char* p = s;
+	while ((p < end) && ((*p == ' ') || ((*p >= '\t') && (*p <= '\r'))))
+		p++;
+	const char* q = ((p < end) && (*p == '-')) ? p + 1 : p;
+	if ((q < end) && (((*q >= '0') && (*q <= '9')) || (*q == '.')))
+	{
+		if (!((*q == '0') && (q + 1 < end) && ((q[1] | 0x20) == 'x')))
+		{
+			double d;
+			auto res = from_chars(p, end, d);
+			if ((res.ec == errc()) && ((d == 0) || (fabs(d) >= (numeric_limits< double >::min)())))
+			{
+				x = d;
+				return true;
+			}
+			if (res.ec == errc::invalid_argument)
+				return false;
+		}
+	}
+	else if ((q == end) || ((*q != '+') && ((*q | 0x20) != 'i') && ((*q | 0x20) != 'n')))
+		return false;
+	return StrDouble(string(s, n), x);
+}
+
+// compares two tables cell by cell using the iteration API
+template < class A, class B >
+bool samedata(A& a, B& b)
+{
+	typename A::iterator ia;
+	typename B::iterator ib;
+	LI ra, ca, rb, cb;
+	string va, vb;
+	bool chka = a.BeginIter(ia);
+	bool chkb = b.BeginIter(ib);
+	while (chka && chkb)
+	{
+		a.GetIter(ia, ra, ca, va);
+		b.GetIter(ib, rb, cb, vb);
+		if ((ra != rb) || (ca != cb) || (va != vb))
+			return false;
+		chka = a.NextIter(ia);
+		chkb = b.NextIter(ib);
+	}
+	return (chka == chkb);
+}
+
+// compares the contents of two files
+bool samefile(const char* filename1, const char* filename2)
+{
+	csvmapfile f1;
+	csvmapfile f2;
+	if ((f1.Open(filename1) != 0) || (f2.Open(filename2) != 0))
+		return false;
+	return (f1.size == f2.size) && ((f1.size == 0) || (memcmp(f1.data, f2.data, f1.size) == 0));
+}
+
 // example of using csvdata class
 int main()
 {
@@ -580,6 +6471,536 @@ int main()
 
 	csv.SaveFile("3.csv");
 
+	// speed comparison of loaders
+	clock_t t;
+	csvdata big;
+	for (LI i = 0; i < 200000; i++)
+	{
+		big.SetCell(i, 0, to_string(i));
+		big.SetCell(i, 1, "Name, " + to_string(i % 1000));
+		big.SetCell(i, 2, to_string(i * 0.25));
+		big.SetCell(i, 3, "Some \"quoted\" text");
+		if (i % 10 == 0)
+			big.SetCell(i, 4, "Line\nbreak");
+		big.SetCell(i, 5, "Plain text value " + to_string(i % 7));
+	}
+	big.SaveFile("4.csv");
+
+	// speed comparison of bulk building
+	csvdata bulk;
+	t = clock();
+	for (LI i = 0; i < 200000; i++)
+	{
+		bulk.SetCell(i, 0, to_string(i));
+		bulk.SetCell(i, 2, to_string(i * 0.25));
+		bulk.SetCell(i, 5, "Plain text value " + to_string(i % 7));
+	}
+	t = clock() - t;
+	cout << "SetCell build: " << (double)t / CLOCKS_PER_SEC << endl;
+
+	csvdata bulk2;
+	vector< string > texts(6);
+	vector< string_view > values(6);
+	t = clock();
+	for (LI i = 0; i < 200000; i++)
+	{
+		texts[0] = to_string(i);
+		texts[2] = to_string(i * 0.25);
+		texts[5] = "Plain text value " + to_string(i % 7);
+		for (int j = 0; j < 6; j++)
+			values[j] = texts[j];
+		bulk2.AppendRow(values);
+	}
+	t = clock() - t;
+	cout << "AppendRow build: " << (double)t / CLOCKS_PER_SEC
+		<< (samedata(bulk, bulk2) ? " Accurate" : " Not accurate") << endl;
+
+	vector< csvcell > sorted;
+	for (LI i = 0; i < 200000; i++)
+	{
+		sorted.push_back({ i, 0, to_string(i) });
+		sorted.push_back({ i, 2, to_string(i * 0.25) });
+		sorted.push_back({ i, 5, "Plain text value " + to_string(i % 7) });
+	}
+	t = clock();
+	bulk2.LoadSorted(sorted);
+	t = clock() - t;
+	cout << "LoadSorted build: " << (double)t / CLOCKS_PER_SEC
+		<< (samedata(bulk, bulk2) ? " Accurate" : " Not accurate") << endl;
+
+	csvdata csv1;
+	t = clock();
+	csv1.LoadFile("4.csv");
+	t = clock() - t;
+	cout << "Stream LoadFile: " << (double)t / CLOCKS_PER_SEC << endl;
+
+	csvdata csv2;
+	t = clock();
+	csv2.LoadFileMapped("4.csv");
+	t = clock() - t;
+	cout << "LoadFileMapped: " << (double)t / CLOCKS_PER_SEC
+		<< (samedata(csv1, csv2) ? " Accurate" : " Not accurate") << endl;
+
+	// CRLF line ends, also inside quotes, read the same by all loaders
+	{
+		ofstream crlf("crlf.csv", ios::binary);
+		crlf << "a,\"Line\r\nbreak\"\r\n\"x\"\"y\",\"q\r\nr\r\"\r\nlast\r\n";
+		crlf.close();
+		csvdata a;
+		csvdata b;
+		csvlazy c;
+		a.LoadFile("crlf.csv");
+		b.LoadFileMapped("crlf.csv");
+		c.LoadFile("crlf.csv");
+		cout << "CRLF LoadFileMapped:"
+			<< ((samedata(a, b) && samedata(a, c) && (b.GetCell(0, 1) == "Line\nbreak") && (b.GetCell(1, 1) == "q\nr\r")) ? " Accurate" : " Not accurate") << endl;
+	}
+
+	t = clock();
+	csv2.LoadFileParallel("4.csv");
+	t = clock() - t;
+	cout << "LoadFileParallel: " << (double)t / CLOCKS_PER_SEC
+		<< (samedata(csv1, csv2) ? " Accurate" : " Not accurate") << endl;
+
+	t = clock();
+	csv2.LoadFileAsync("4.csv");
+	t = clock() - t;
+	cout << "LoadFileAsync: " << (double)t / CLOCKS_PER_SEC
+		<< (samedata(csv1, csv2) ? " Accurate" : " Not accurate") << endl;
+
+	// columns 0 and 2 only, with the same cells erased from a full load
+	csv2.Clear();
+	t = clock();
+	csv2.LoadFile("4.csv", { 0, 2 });
+	t = clock() - t;
+	csvdata csv3;
+	csv3.LoadFileMapped("4.csv");
+	for (LI i = 0; i < 200000; i++)
+		for (LI j : { 1, 3, 4, 5 })
+			csv3.EraseCell(i, j);
+	cout << "Projected LoadFile: " << (double)t / CLOCKS_PER_SEC
+		<< (samedata(csv2, csv3) ? " Accurate" : " Not accurate") << endl;
+
+	csv2.Clear();
+	t = clock();
+	csv2.LoadFile("4.csv", {}, 0, 1000);
+	t = clock() - t;
+	csv3.LoadFileMapped("4.csv");
+	for (LI i = 1000; i < 200000; i++)
+		for (LI j = 0; j < 6; j++)
+			csv3.EraseCell(i, j);
+	cout << "LoadFile of 1000 rows: " << (double)t / CLOCKS_PER_SEC
+		<< (samedata(csv2, csv3) ? " Accurate" : " Not accurate") << endl;
+
+	// a writer changes columns 0 and 1 of a row together in each update while
+	// readers check that every view has both or neither of the changes
+	{
+		csvshared shared;
+		t = clock();
+		shared.LoadFile("4.csv");
+		t = clock() - t;
+		csvview loaded = shared.View();
+		cout << "csvshared LoadFile: " << (double)t / CLOCKS_PER_SEC
+			<< (samedata(csv1, loaded) ? " Accurate" : " Not accurate") << endl;
+
+		shared.Update([&](csvshared::draft& d)
+		{
+			for (LI i = 0; i < 200000; i++)
+				d.SetCell(i, 1, d.GetCell(i, 0));
+		});
+		bool isgood = true;
+		t = clock();
+		thread writer([&]()
+		{
+			for (LI i = 0; i < 20000; i++)
+				shared.Update([&](csvshared::draft& d)
+				{
+					LI r = (i * 7919) % 200000;
+					d.SetCell(r, 0, "v" + to_string(i));
+					d.SetCell(r, 1, "v" + to_string(i));
+				});
+		});
+		vector< thread > readers;
+		for (int k = 0; k < 2; k++)
+			readers.emplace_back([&, k]()
+			{
+				for (LI i = 0; i < 200000; i++)
+				{
+					csvview view = shared.View();
+					LI r = (i * 31 + k) % 200000;
+					if (view.GetCell(r, 0) != view.GetCell(r, 1))
+						isgood = false;
+				}
+			});
+		writer.join();
+		for (auto& th : readers)
+			th.join();
+		t = clock() - t;
+		cout << "csvshared updates and views: " << (double)t / CLOCKS_PER_SEC
+			<< (isgood ? " Accurate" : " Not accurate") << endl;
+	}
+
+	// 4.csv appended to 7.csv in ten parts, loaded after each
+	{
+		csvmapfile whole;
+		whole.Open("4.csv");
+		FILE* f = fopen("7.csv", "wb");
+		fclose(f);
+		csv2.Clear();
+		t = 0;
+		for (size_t k = 0; k < 10; k++)
+		{
+			f = fopen("7.csv", "ab");
+			size_t from = whole.size * k / 10;
+			size_t to = whole.size * (k + 1) / 10;
+			fwrite(whole.data + from, 1, to - from, f);
+			fclose(f);
+			clock_t t1 = clock();
+			csv2.LoadFileTail("7.csv");
+			t += clock() - t1;
+		}
+		cout << "LoadFileTail in 10 parts: " << (double)t / CLOCKS_PER_SEC
+			<< (samedata(csv1, csv2) ? " Accurate" : " Not accurate") << endl;
+	}
+
+	// rows with column 5 equal to "Plain text value 3"
+	csv2.Clear();
+	t = clock();
+	csv2.LoadFileWhere("4.csv", 5, "Plain text value 3");
+	t = clock() - t;
+	csv3.LoadFileMapped("4.csv");
+	for (LI i = 0; i < 200000; i++)
+		if (i % 7 != 3)
+			for (LI j = 0; j < 6; j++)
+				csv3.EraseCell(i, j);
+	cout << "Filtered LoadFile: " << (double)t / CLOCKS_PER_SEC
+		<< (samedata(csv2, csv3) ? " Accurate" : " Not accurate") << endl;
+
+	csvcolumns cols;
+	t = clock();
+	cols.LoadFile("4.csv");
+	t = clock() - t;
+	cout << "csvcolumns LoadFile: " << (double)t / CLOCKS_PER_SEC
+		<< (samedata(csv1, cols) ? " Accurate" : " Not accurate") << endl;
+
+	// 4.csv has int, double and string columns, column 4 mostly empty
+	{
+		csvcolumns typed;
+		t = clock();
+		typed.LoadFile("4.csv", true, true);
+		t = clock() - t;
+		csvschema schema = typed.GetSchema();
+		bool isgood = samedata(csv1, typed) && (schema.types.size() == 6) && (schema.types[0] == csvint)
+			&& (schema.types[1] == csvstring) && (schema.types[2] == csvdouble) && (schema.nulls[4] > 0.8);
+		cout << "csvcolumns typed LoadFile: " << (double)t / CLOCKS_PER_SEC << (isgood ? " Accurate" : " Not accurate") << endl;
+
+		double sum1 = 0;
+		double sum2 = 0;
+		double x;
+		t = clock();
+		for (int k = 0; k < 10; k++)
+			for (LI i = 0; i < 200000; i++)
+				if (cols.GetCellDouble(i, 2, x))
+					sum1 += x;
+		t = clock() - t;
+		cout << "csvcolumns GetCellDouble: " << (double)t / CLOCKS_PER_SEC << endl;
+		t = clock();
+		for (int k = 0; k < 10; k++)
+			for (LI i = 0; i < 200000; i++)
+				if (typed.GetCellDouble(i, 2, x))
+					sum2 += x;
+		t = clock() - t;
+		cout << "csvcolumns typed GetCellDouble: " << (double)t / CLOCKS_PER_SEC << ((sum1 == sum2) ? " Accurate" : " Not accurate") << endl;
+	}
+
+	csvlazy lazy;
+	t = clock();
+	lazy.LoadFile("4.csv");
+	t = clock() - t;
+	cout << "csvlazy LoadFile: " << (double)t / CLOCKS_PER_SEC
+		<< (samedata(csv1, lazy) ? " Accurate" : " Not accurate") << endl;
+
+	csvcells cells;
+	cells.SetIntern(1);
+	cells.SetIntern(5);
+	t = clock();
+	cells.LoadFile("4.csv");
+	t = clock() - t;
+	cout << "csvcells LoadFile: " << (double)t / CLOCKS_PER_SEC
+		<< (samedata(csv1, cells) ? " Accurate" : " Not accurate") << endl;
+
+	// speed comparison of snapshots
+	t = clock();
+	csv1.SaveSnapshot("4.snap");
+	t = clock() - t;
+	cout << "SaveSnapshot: " << (double)t / CLOCKS_PER_SEC << endl;
+
+	t = clock();
+	csv2.LoadSnapshot("4.snap");
+	t = clock() - t;
+	cout << "LoadSnapshot: " << (double)t / CLOCKS_PER_SEC
+		<< (samedata(csv1, csv2) ? " Accurate" : " Not accurate") << endl;
+
+	csvsnapshot snap;
+	t = clock();
+	snap.Open("4.snap");
+	t = clock() - t;
+	cout << "csvsnapshot Open: " << (double)t / CLOCKS_PER_SEC
+		<< (samedata(csv1, snap) ? " Accurate" : " Not accurate") << endl;
+	snap.Close();
+
+#if defined(CSV_ZLIB) || defined(CSV_ZSTD)
+	// speed comparison of compressed files
+#ifdef CSV_ZLIB
+	const char* packname = "4.csv.gz";
+#else
+	const char* packname = "4.csv.zst";
+#endif
+	t = clock();
+	csv1.SaveFile(packname);
+	t = clock() - t;
+	cout << "Compressed SaveFile: " << (double)t / CLOCKS_PER_SEC << endl;
+
+	t = clock();
+	csv2.LoadFile(packname);
+	t = clock() - t;
+	cout << "Compressed LoadFile: " << (double)t / CLOCKS_PER_SEC
+		<< (samedata(csv1, csv2) ? " Accurate" : " Not accurate") << endl;
+#endif
+
+	// speed comparison of writers
+	t = clock();
+	csv1.SaveFile("5.csv");
+	t = clock() - t;
+	cout << "Stream SaveFile: " << (double)t / CLOCKS_PER_SEC << endl;
+
+	t = clock();
+	csv1.SaveFileBuffered("6.csv");
+	t = clock() - t;
+	cout << "SaveFileBuffered: " << (double)t / CLOCKS_PER_SEC
+		<< (samefile("5.csv", "6.csv") ? " Accurate" : " Not accurate") << endl;
+
+	t = clock();
+	csv1.SaveFileBuffered("6.csv", true);
+	t = clock() - t;
+	cout << "SaveFileBuffered direct: " << (double)t / CLOCKS_PER_SEC
+		<< (samefile("5.csv", "6.csv") ? " Accurate" : " Not accurate") << endl;
+
+	t = clock();
+	csv1.SaveFileParallel("6.csv");
+	t = clock() - t;
+	cout << "SaveFileParallel: " << (double)t / CLOCKS_PER_SEC
+		<< (samefile("5.csv", "6.csv") ? " Accurate" : " Not accurate") << endl;
+
+	// speed comparison of random updates
+	csvhash hash;
+	t = clock();
+	hash.LoadFile("4.csv");
+	t = clock() - t;
+	cout << "csvhash LoadFile: " << (double)t / CLOCKS_PER_SEC
+		<< (samedata(csv1, hash) ? " Accurate" : " Not accurate") << endl;
+
+	t = clock();
+	for (LI i = 0; i < 1000000; i++)
+		csv2.SetCell((i * 7919) % 200000, i % 6, to_string(i));
+	t = clock() - t;
+	cout << "Random SetCell: " << (double)t / CLOCKS_PER_SEC << endl;
+
+	t = clock();
+	for (LI i = 0; i < 1000000; i++)
+		hash.SetCell((i * 7919) % 200000, i % 6, to_string(i));
+	t = clock() - t;
+	cout << "csvhash random SetCell: " << (double)t / CLOCKS_PER_SEC
+		<< (samedata(csv2, hash) ? " Accurate" : " Not accurate") << endl;
+	csv2.LoadFile("4.csv");
+
+	// speed comparison of searches
+	LI row1, column1, row2, column2;
+	bool chk1 = true;
+	bool chk2 = true;
+	t = clock();
+	for (LI i = 0; i < 20; i++)
+		chk1 = chk1 && csv1.Search(to_string(199999 - i), row1, column1, true);
+	t = clock() - t;
+	cout << "Search: " << (double)t / CLOCKS_PER_SEC << endl;
+
+	csv2.SetIndex(true);
+	t = clock();
+	for (LI i = 0; i < 20; i++)
+		chk2 = chk2 && csv2.Search(to_string(199999 - i), row2, column2, true);
+	t = clock() - t;
+	cout << "Indexed Search: " << (double)t / CLOCKS_PER_SEC
+		<< ((chk1 && chk2 && (row1 == row2) && (column1 == column2)) ? " Accurate" : " Not accurate") << endl;
+
+	// speed comparison of numeric reads
+	double sum1 = 0;
+	double sum2 = 0;
+	double x;
+	csv2.SetNumberCache(false);
+	t = clock();
+	for (int k = 0; k < 10; k++)
+		for (LI i = 0; i < 200000; i++)
+			if (csv2.GetCellDouble(i, 2, x))
+				sum2 += x;
+	t = clock() - t;
+	cout << "GetCellDouble: " << (double)t / CLOCKS_PER_SEC << endl;
+
+	t = clock();
+	for (int k = 0; k < 10; k++)
+		for (LI i = 0; i < 200000; i++)
+			if (csv1.GetCellDouble(i, 2, x))
+				sum1 += x;
+	t = clock() - t;
+	cout << "Cached GetCellDouble: " << (double)t / CLOCKS_PER_SEC
+		<< ((sum1 == sum2) ? " Accurate" : " Not accurate") << endl;
+
+	// speed comparison of column aggregation
+	csvstats stats1, stats2;
+	t = clock();
+	for (int k = 0; k < 10; k++)
+	{
+		stats1.count = 0;
+		stats1.sum = 0;
+		stats1.min = numeric_limits< double >::infinity();
+		stats1.max = -stats1.min;
+		for (LI i = 0; i < 200000; i++)
+			if (csv2.GetCellDouble(i, 2, x))
+			{
+				stats1.count++;
+				stats1.sum += x;
+				if (x < stats1.min)
+					stats1.min = x;
+				if (x > stats1.max)
+					stats1.max = x;
+			}
+	}
+	t = clock() - t;
+	cout << "GetCellDouble aggregation: " << (double)t / CLOCKS_PER_SEC << endl;
+
+	t = clock();
+	for (int k = 0; k < 10; k++)
+		csv1.ColumnStats(2, stats2);
+	t = clock() - t;
+	cout << "ColumnStats: " << (double)t / CLOCKS_PER_SEC
+		<< (((stats1.count == stats2.count) && (stats1.min == stats2.min) && (stats1.max == stats2.max)
+			&& (fabs(stats1.sum - stats2.sum) <= 1e-9 * fabs(stats1.sum))) ? " Accurate" : " Not accurate") << endl;
+
+	// 4.csv has the row number in column 0, column 2 grows with it and
+	// column 5 repeats seven values
+	{
+		csvdata sorted = csv1;
+		t = clock();
+		sorted.SortRows({ 2 }, true, true);
+		t = clock() - t;
+		bool isgood = true;
+		for (LI i = 0; i < 200000; i++)
+			if (sorted.GetCell(i, 0) != to_string(199999 - i))
+				isgood = false;
+		cout << "SortRows numeric: " << (double)t / CLOCKS_PER_SEC << (isgood ? " Accurate" : " Not accurate") << endl;
+
+		// stable: the rows of each value of column 5 stay in descending order
+		t = clock();
+		sorted.SortRows({ 5 });
+		t = clock() - t;
+		isgood = true;
+		for (LI i = 1; i < 200000; i++)
+		{
+			int c = sorted.GetCell(i - 1, 5).compare(sorted.GetCell(i, 5));
+			if ((c > 0) || ((c == 0) && (stol(sorted.GetCell(i - 1, 0)) < stol(sorted.GetCell(i, 0)))))
+				isgood = false;
+		}
+		cout << "SortRows text: " << (double)t / CLOCKS_PER_SEC << (isgood ? " Accurate" : " Not accurate") << endl;
+	}
+
+	// column 1 of 4.csv is "Name, " and the row number modulo 1000, joined to
+	// a table of the even names
+	{
+		csvdata names;
+		for (LI i = 0; i < 500; i++)
+		{
+			names.SetCell(i, 0, "Name, " + to_string(998 - 2 * i));
+			names.SetCell(i, 1, "Value " + to_string(998 - 2 * i));
+		}
+		csvdata joined;
+		t = clock();
+		csv1.Join(names, { 1 }, { 0 }, { 1 }, joined);
+		t = clock() - t;
+		bool isgood = true;
+		LI i = 0;
+		for (LI r = 0; r < 200000; r += 2)
+			if ((joined.GetCell(i, 0) != to_string(r)) || (joined.GetCell(i++, 6) != "Value " + to_string(r % 1000)))
+				isgood = false;
+		if (joined.GetCell(i, 0) != "")
+			isgood = false;
+		cout << "Join inner: " << (double)t / CLOCKS_PER_SEC << (isgood ? " Accurate" : " Not accurate") << endl;
+
+		t = clock();
+		csv1.Join(names, { 1 }, { 0 }, { 1 }, joined, true);
+		t = clock() - t;
+		isgood = true;
+		for (LI r = 0; r < 200000; r++)
+			if ((joined.GetCell(r, 0) != to_string(r)) || (joined.GetCell(r, 6) != ((r % 2) ? "" : "Value " + to_string(r % 1000))))
+				isgood = false;
+		cout << "Join left: " << (double)t / CLOCKS_PER_SEC << (isgood ? " Accurate" : " Not accurate") << endl;
+	}
+
+	// column 5 of 4.csv repeats seven values over the rows and column 2 is a
+	// quarter of the row number
+	{
+		vector< csvgroup > groups1;
+		vector< csvgroup > groups2;
+		t = clock();
+		csv1.GroupBy({ 5 }, { 2, 0 }, groups1);
+		t = clock() - t;
+		bool isgood = (groups1.size() == 7);
+		for (LI v = 0; isgood && (v < 7); v++)
+		{
+			csvgroup& g = groups1[v];
+			double sum = 0;
+			size_t count = 0;
+			for (LI i = v; i < 200000; i += 7)
+			{
+				sum += i * 0.25;
+				count++;
+			}
+			isgood = (g.keys[0] == "Plain text value " + to_string(v)) && (g.rows == count) && (g.stats[0].count == count)
+				&& (g.stats[0].min == v * 0.25) && (g.stats[0].max == (v + (count - 1) * 7) * 0.25)
+				&& (fabs(g.stats[0].sum - sum) <= 1e-9 * sum) && (g.stats[1].count == count);
+		}
+		cout << "GroupBy: " << (double)t / CLOCKS_PER_SEC << (isgood ? " Accurate" : " Not accurate") << endl;
+
+		csvreader rows;
+		t = clock();
+		rows.Open("4.csv");
+		rows.GroupBy({ 5 }, { 2, 0 }, groups2);
+		t = clock() - t;
+		for (size_t k = 0; k < groups1.size(); k++)
+			if ((groups2.size() != groups1.size()) || (groups2[k].keys != groups1[k].keys) || (groups2[k].rows != groups1[k].rows)
+				|| (groups2[k].stats[0].count != groups1[k].stats[0].count) || (groups2[k].stats[1].max != groups1[k].stats[1].max)
+				|| (fabs(groups2[k].stats[0].sum - groups1[k].stats[0].sum) > 1e-9 * fabs(groups1[k].stats[0].sum)))
+				isgood = false;
+		cout << "csvreader GroupBy: " << (double)t / CLOCKS_PER_SEC << (isgood ? " Accurate" : " Not accurate") << endl;
+	}
+
+	// sum of column 2 without loading the file
+	sum1 = 0;
+	sum2 = 0;
+	for (LI i = 0; i < 200000; i++)
+		if (csv1.GetCellDouble(i, 2, x))
+			sum1 += x;
+	csvreader reader;
+	t = clock();
+	reader.Open("4.csv");
+	reader.ForEachRow([&](LI, vector< string_view >& fields)
+	{
+		if ((fields.size() > 2) && StrDouble(fields[2].data(), fields[2].size(), x))
+			sum2 += x;
+		return true;
+	});
+	t = clock() - t;
+	cout << "csvreader sum: " << (double)t / CLOCKS_PER_SEC
+		<< ((sum1 == sum2) ? " Accurate" : " Not accurate") << endl;
+
 	puts("Press Enter to exit...\n");
 	getchar();
 